@@ -1,157 +1,2538 @@
-// gcc -O3 malloc-glib.c `pkg-config --cflags --libs glib-2.0` -o malloc-glib
+// gcc -O3 malloc-glib.c `pkg-config --cflags --libs glib-2.0` -lm -o malloc-glib
 // 30% runtime of this bench is due to malloc
 
 #include <glib.h>
+#include <linux/perf_event.h>
+#include <malloc.h>
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
 #include <time.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __GLIBC__
+#include <gnu/libc-version.h>
+#endif
 
 gint compare_ints(gconstpointer a, gconstpointer b) {
     return (*(const int*)a - *(const int*)b);
 }
 
+gint compare_ints_data(gconstpointer a, gconstpointer b, gpointer user_data) {
+    return compare_ints(a, b);
+}
+
+// Wall clock and cpu time at one point. The cpu time is the whole
+// process's, so for the concurrent benchmarks it adds up every thread and
+// shows time spent blocked as the gap to the wall clock.
+typedef struct {
+    double wall;
+    double cpu;
+} BenchClock;
+
+static BenchClock bench_clock() {
+    BenchClock now;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now.wall = ts.tv_sec + ts.tv_nsec / 1e9;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    now.cpu = ts.tv_sec + ts.tv_nsec / 1e9;
+    return now;
+}
+
+// Current resident set size in KB, from /proc/self/statm
+static long current_rss_kb() {
+    long size = 0, resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm) {
+        if (fscanf(statm, "%ld %ld", &size, &resident) != 2)
+            resident = 0;
+        fclose(statm);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// Peak resident set size of the whole process in KB
+static long peak_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Make the compiler assume the memory behind p is used, so stores into a
+// container that is freed right after aren't eliminated
+static inline void clobber(void *p) {
+    __asm__ volatile("" : : "r"(p) : "memory");
+}
+
+// Memory starting on a cache line, released with free(). Like g_malloc it
+// aborts when out of memory.
+static gpointer cache_line_alloc(gsize size) {
+    gpointer p;
+    if (posix_memalign(&p, 64, size) != 0)
+        g_error("cache_line_alloc: failed to allocate %" G_GSIZE_FORMAT " bytes", size);
+    return p;
+}
+
+// xorshift64, for random indices and keys that are the same every run
+static inline guint64 random_next(guint64 *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// Count last level cache misses of the calling thread from here on. Returns
+// -1 where perf events aren't available (no PMU, perf_event_paranoid, VMs).
+static int cache_misses_start() {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Misses since cache_misses_start(), or -1 without a counter
+static long long cache_misses_stop(int fd) {
+    long long count = -1;
+    if (fd < 0)
+        return -1;
+    if (read(fd, &count, sizeof(count)) != sizeof(count))
+        count = -1;
+    close(fd);
+    return count;
+}
+
+// Traversal summary: payload bandwidth and cache misses per element
+static void print_traversal(const char *container, double seconds, long elements,
+                            long long misses) {
+    printf("%s: Traversal: %.2f GB/s of int payload, ", container,
+           elements * sizeof(int) / seconds / 1e9);
+    if (misses >= 0)
+        printf("%.3f cache misses per element\n", (double)misses / elements);
+    else
+        printf("cache misses n/a\n");
+}
+
+static void print_op(const char *container, const char *op, double seconds, double cpu_seconds,
+                     long ops) {
+    printf("%s: %s time: %f seconds, cpu %f seconds (%.2f ns/op, %.2f Mops/s)\n", container, op,
+           seconds, cpu_seconds, seconds * 1e9 / ops, ops / seconds / 1e6);
+}
+
+// Every timed operation of every repetition is logged here. The log is a
+// shared mapping, so operations timed in the forked children of
+// run_isolated() land in it too, and main writes it out with --json.
+#define MAX_OP_RECORDS 8192
+
+typedef struct {
+    char container[64];
+    char op[64];
+    char keys[16]; // key distribution, empty for containers without keys
+    int entries;
+    long ops;
+    double wall_seconds;
+    double cpu_seconds;
+    long peak_rss_kb;
+} OpRecord;
+
+typedef struct {
+    gint count;
+    OpRecord records[MAX_OP_RECORDS];
+} OpRecordLog;
+
+static OpRecordLog *op_log;
+// Warmup passes are negative and not logged
+static int current_repetition;
+// Workload settings from the command line; the records are filed under
+// the size and the key distribution of the benchmark that is running
+static int workload_entries = 100000000;
+static double lookup_hit_ratio = 1.0;
+static const char *current_keys;
+
+// Print one timed operation and log it under the given container size;
+// returns its wall clock seconds
+static double record_op_sized(const char *container, const char *op, BenchClock start,
+                              BenchClock end, long ops, int entries) {
+    double seconds = end.wall - start.wall;
+    print_op(container, op, seconds, end.cpu - start.cpu, ops);
+    if (op_log != NULL && current_repetition >= 0) {
+        gint slot = g_atomic_int_add(&op_log->count, 1);
+        if (slot < MAX_OP_RECORDS) {
+            OpRecord *record = &op_log->records[slot];
+            snprintf(record->container, sizeof(record->container), "%s", container);
+            snprintf(record->op, sizeof(record->op), "%s", op);
+            snprintf(record->keys, sizeof(record->keys), "%s",
+                     current_keys != NULL ? current_keys : "");
+            record->entries = entries;
+            record->ops = ops;
+            record->wall_seconds = seconds;
+            record->cpu_seconds = end.cpu - start.cpu;
+            record->peak_rss_kb = peak_rss_kb();
+        }
+    }
+    return seconds;
+}
+
+// The same for an operation on a container of workload_entries elements
+static double record_op(const char *container, const char *op, BenchClock start, BenchClock end,
+                        long ops) {
+    return record_op_sized(container, op, start, end, ops, workload_entries);
+}
+
+#ifdef __GLIBC__
+// Count malloc/calloc/realloc calls, GLib's own included, by defining them
+// here on top of glibc's allocator. The count is per thread so it costs no
+// shared cache line.
+static __thread long allocation_count;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+
+void *malloc(size_t size) {
+    allocation_count++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    allocation_count++;
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size) {
+    allocation_count++;
+    return __libc_realloc(p, size);
+}
+
+// Bytes handed out by malloc right now, chunk overhead included
+static long heap_bytes_in_use() {
+#if __GLIBC__ > 2 || __GLIBC_MINOR__ >= 33
+    struct mallinfo2 info = mallinfo2();
+#else
+    struct mallinfo info = mallinfo();
+#endif
+    return (long)info.uordblks + (long)info.hblkhd;
+}
+#else
+static long allocation_count;
+
+static long heap_bytes_in_use() {
+    return 0;
+}
+#endif
+
+// Arena: bump allocation out of 1MB chunks, all freed at once. There is
+// no per-element header and no free path, which is all a container that is
+// torn down in one go needs.
+#define ARENA_CHUNK_BYTES (1 << 20)
+
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+} ArenaChunk;
+
+typedef struct {
+    ArenaChunk *chunks;
+    char *next;
+    char *end;
+} Arena;
+
+static void arena_grow(Arena *arena, gsize size) {
+    gsize bytes = MAX(ARENA_CHUNK_BYTES, size + sizeof(ArenaChunk));
+    ArenaChunk *chunk = g_malloc(bytes);
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->next = (char *)(chunk + 1);
+    arena->end = (char *)chunk + bytes;
+}
+
+static inline gpointer arena_alloc(Arena *arena, gsize size) {
+    size = (size + 7) & ~(gsize)7;
+    if (G_UNLIKELY(arena->next == NULL || (gsize)(arena->end - arena->next) < size))
+        arena_grow(arena, size);
+    gpointer p = arena->next;
+    arena->next += size;
+    return p;
+}
+
+static void arena_free_all(Arena *arena) {
+    while (arena->chunks) {
+        ArenaChunk *next = arena->chunks->next;
+        g_free(arena->chunks);
+        arena->chunks = next;
+    }
+    arena->next = arena->end = NULL;
+}
+
+// The per-element allocations of the container benchmarks (GList data,
+// GHashTable and GTree keys and values) go through element_alloc(), which
+// is g_malloc or, with use_arena set, a thread-local arena that is freed in
+// bulk once the container is gone. The containers' own nodes still come
+// from GLib.
+static gboolean use_arena;
+static __thread Arena element_arena;
+
+static inline gpointer element_alloc(gsize size) {
+    return use_arena ? arena_alloc(&element_arena, size) : g_malloc(size);
+}
+
+static void element_release_all() {
+    arena_free_all(&element_arena);
+}
+
+static const char *element_allocator_name() {
+    return use_arena ? "arena" : "g_malloc";
+}
+
+// What compare_element_allocators() needs from one benchmark run
+typedef struct {
+    double seconds; // all timed phases together
+    long rss_kb;    // RSS growth with the container fully built
+} BenchTotals;
+
+// Run bench in a forked child, so memory the allocator kept from an earlier
+// run can't hide the RSS of this one
+static BenchTotals run_isolated(BenchTotals (*bench)()) {
+    BenchTotals totals = { 0.0, 0 };
+    int fds[2];
+    fflush(stdout);
+    if (pipe(fds) != 0)
+        return bench();
+    pid_t child = fork();
+    if (child == 0) {
+        close(fds[0]);
+#ifdef __GLIBC__
+        // hand back heap the parent already freed, so RSS growth is the bench's own
+        malloc_trim(0);
+#endif
+        totals = bench();
+        fflush(stdout);
+        if (write(fds[1], &totals, sizeof(totals)) != sizeof(totals))
+            _exit(1);
+        _exit(0);
+    }
+    close(fds[1]);
+    if (child < 0 || read(fds[0], &totals, sizeof(totals)) != sizeof(totals))
+        fprintf(stderr, "ERROR: benchmark child failed\n");
+    close(fds[0]);
+    if (child > 0)
+        waitpid(child, NULL, 0);
+    return totals;
+}
+
+// Run bench with g_malloc'd elements and again with arena elements, then
+// print the speedup and RSS difference
+static void compare_element_allocators(const char *container, BenchTotals (*bench)()) {
+    use_arena = FALSE;
+    BenchTotals with_malloc = run_isolated(bench);
+    use_arena = TRUE;
+    BenchTotals with_arena = run_isolated(bench);
+    use_arena = FALSE;
+    printf("%s: arena speedup %.2fx, RSS %ld KB with g_malloc, %ld KB with arena (%+ld KB)\n",
+           container, with_malloc.seconds / with_arena.seconds, with_malloc.rss_kb,
+           with_arena.rss_kb, with_arena.rss_kb - with_malloc.rss_kb);
+}
+
 void garray_bench() {
     GArray *array;
     int i;
-    const int num_entries = 100000000;
+    const int num_entries = workload_entries;
+    long rss_before = current_rss_kb();
 
     // Initialize the GArray
     array = g_array_new(FALSE, FALSE, sizeof(int));
 
     // Timing the insertion (append)
-    clock_t start = clock();
+    BenchClock start = bench_clock();
     for (i = 0; i < num_entries; i++) {
         g_array_append_val(array, i);
     }
-    clock_t end = clock();
-    printf("GArray: Insertion (append) time: %f seconds\n", (double)(end - start) / CLOCKS_PER_SEC);
+    BenchClock end = bench_clock();
+    record_op("GArray", "Insertion (append)", start, end, num_entries);
+    printf("GArray: RSS after insertion: +%ld KB\n", current_rss_kb() - rss_before);
 
     // Timing the deletion (removing elements from the end)
-    start = clock();
+    start = bench_clock();
     for (i = num_entries - 1; i >= 0; i--) {
         g_array_remove_index(array, i);
     }
-    end = clock();
-    printf("GArray: Deletion time: %f seconds\n", (double)(end - start) / CLOCKS_PER_SEC);
+    end = bench_clock();
+    record_op("GArray", "Deletion", start, end, num_entries);
+    printf("GArray: RSS after deletion: +%ld KB\n", current_rss_kb() - rss_before);
 
     // Free the array
     g_array_free(array, TRUE);
+
+    // Bulk append in blocks, into an array sized up front
+    int block[1024];
+    for (i = 0; i < 1024; i++)
+        block[i] = i;
+    start = bench_clock();
+    array = g_array_sized_new(FALSE, FALSE, sizeof(int), num_entries);
+    for (i = 0; i < num_entries; i += 1024) {
+        g_array_append_vals(array, block, MIN(1024, num_entries - i));
+    }
+    end = bench_clock();
+    record_op("GArray", "Bulk insertion (sized, 1024 per call)", start, end, num_entries);
+    g_array_free(array, TRUE);
+}
+
+// GArray deletion patterns. Only removal from the tail and
+// g_array_remove_index_fast are O(1); removing from the head, at a random
+// index, or a range from the front moves everything behind it, which makes
+// a queue on a GArray quadratic. Those patterns run on at most
+// QUADRATIC_ENTRIES elements so a 100M run still finishes. They are
+// recorded under the size they really ran at, so --sweep shows their ns/op
+// growing with the size up to the cap.
+#define QUADRATIC_ENTRIES 100000
+#define REMOVE_RANGE_BATCH 1024
+#define QUEUE_DEPTH 10000
+
+static GArray *garray_filled(int n) {
+    GArray *array = g_array_sized_new(FALSE, FALSE, sizeof(int), n);
+    int i;
+    for (i = 0; i < n; i++)
+        g_array_append_val(array, i);
+    return array;
 }
 
-void glist_bench() {
+void garray_deletion_bench() {
+    GArray *array;
+    int i;
+    const int num_entries = workload_entries;
+    const int quadratic_entries = MIN(num_entries, QUADRATIC_ENTRIES);
+    guint64 state = 88172645463325252ULL;
+
+    if (quadratic_entries < num_entries)
+        printf("GArray: head, random, range and queue deletion capped at %d entries\n",
+               quadratic_entries);
+
+    array = garray_filled(num_entries);
+    BenchClock start = bench_clock();
+    for (i = 0; i < num_entries; i++) {
+        g_array_remove_index(array, array->len - 1);
+    }
+    BenchClock end = bench_clock();
+    record_op("GArray", "Deletion (tail)", start, end, num_entries);
+    g_array_free(array, TRUE);
+
+    array = garray_filled(quadratic_entries);
+    start = bench_clock();
+    for (i = 0; i < quadratic_entries; i++) {
+        g_array_remove_index(array, 0);
+    }
+    end = bench_clock();
+    record_op_sized("GArray", "Deletion (head)", start, end, quadratic_entries, quadratic_entries);
+    g_array_free(array, TRUE);
+
+    array = garray_filled(quadratic_entries);
+    start = bench_clock();
+    for (i = 0; i < quadratic_entries; i++) {
+        g_array_remove_index(array, random_next(&state) % array->len);
+    }
+    end = bench_clock();
+    record_op_sized("GArray", "Deletion (random index)", start, end, quadratic_entries,
+                    quadratic_entries);
+    g_array_free(array, TRUE);
+
+    // remove_index_fast moves the last element into the hole, so order is lost
+    array = garray_filled(num_entries);
+    start = bench_clock();
+    for (i = 0; i < num_entries; i++) {
+        g_array_remove_index_fast(array, random_next(&state) % array->len);
+    }
+    end = bench_clock();
+    record_op("GArray", "Deletion (remove_index_fast, random index)", start, end, num_entries);
+    g_array_free(array, TRUE);
+
+    array = garray_filled(quadratic_entries);
+    start = bench_clock();
+    while (array->len > 0) {
+        g_array_remove_range(array, 0, MIN(REMOVE_RANGE_BATCH, array->len));
+    }
+    end = bench_clock();
+    record_op_sized("GArray", "Deletion (remove_range from head, 1024 per call)", start, end,
+                    quadratic_entries, quadratic_entries);
+    g_array_free(array, TRUE);
+
+    // A queue at steady state: append to the back, remove from the front;
+    // filed under its depth, like the IntDeque queue
+    array = garray_filled(MIN(num_entries, QUEUE_DEPTH));
+    start = bench_clock();
+    for (i = 0; i < quadratic_entries; i++) {
+        g_array_append_val(array, i);
+        g_array_remove_index(array, 0);
+    }
+    end = bench_clock();
+    record_op_sized("GArray", "Queue (append, remove head)", start, end, quadratic_entries,
+                    MIN(num_entries, QUEUE_DEPTH));
+    g_array_free(array, TRUE);
+}
+
+// IntArray: a growable int array laid out like GArray (data, len) but
+// specialised for int, so appends inline to a store and a compare. It has
+// a reserve call, bulk append, and shrinks with hysteresis: capacity halves
+// only once len falls to a quarter of it, so push/pop around a boundary
+// never ping-pongs realloc.
+typedef struct {
+    int *data;
+    guint len;
+    guint capacity;
+} IntArray;
+
+#define INT_ARRAY_MIN_CAPACITY 16
+
+static void int_array_resize(IntArray *array, guint capacity) {
+    array->data = g_renew(int, array->data, capacity);
+    array->capacity = capacity;
+}
+
+static IntArray *int_array_new() {
+    IntArray *array = g_new0(IntArray, 1);
+    return array;
+}
+
+static void int_array_reserve(IntArray *array, guint capacity) {
+    if (capacity > array->capacity)
+        int_array_resize(array, capacity);
+}
+
+static inline void int_array_append_val(IntArray *array, int value) {
+    if (G_UNLIKELY(array->len == array->capacity))
+        int_array_resize(array, MAX(INT_ARRAY_MIN_CAPACITY, array->capacity * 2));
+    array->data[array->len++] = value;
+}
+
+static void int_array_append_vals(IntArray *array, const int *values, guint n) {
+    if (array->len + n > array->capacity) {
+        guint capacity = MAX(INT_ARRAY_MIN_CAPACITY, array->capacity);
+        while (capacity < array->len + n)
+            capacity *= 2;
+        int_array_resize(array, capacity);
+    }
+    memcpy(array->data + array->len, values, n * sizeof(int));
+    array->len += n;
+}
+
+static inline void int_array_remove_last(IntArray *array) {
+    array->len--;
+    if (G_UNLIKELY(array->len <= array->capacity / 4 && array->capacity > INT_ARRAY_MIN_CAPACITY))
+        int_array_resize(array, array->capacity / 2);
+}
+
+static void int_array_free(IntArray *array) {
+    g_free(array->data);
+    g_free(array);
+}
+
+void intarray_bench() {
+    IntArray *array;
+    int i;
+    const int num_entries = workload_entries;
+    long rss_before = current_rss_kb();
+
+    array = int_array_new();
+
+    // Timing the insertion (append)
+    BenchClock start = bench_clock();
+    for (i = 0; i < num_entries; i++) {
+        int_array_append_val(array, i);
+    }
+    clobber(array->data);
+    BenchClock end = bench_clock();
+    record_op("IntArray", "Insertion (append)", start, end, num_entries);
+    printf("IntArray: RSS after insertion: +%ld KB\n", current_rss_kb() - rss_before);
+
+    // Timing the deletion (removing elements from the end)
+    start = bench_clock();
+    for (i = num_entries - 1; i >= 0; i--) {
+        int_array_remove_last(array);
+    }
+    end = bench_clock();
+    record_op("IntArray", "Deletion", start, end, num_entries);
+    printf("IntArray: RSS after deletion: +%ld KB\n", current_rss_kb() - rss_before);
+
+    int_array_free(array);
+
+    // Bulk append in blocks, after reserving the final size
+    int block[1024];
+    for (i = 0; i < 1024; i++)
+        block[i] = i;
+    start = bench_clock();
+    array = int_array_new();
+    int_array_reserve(array, num_entries);
+    for (i = 0; i < num_entries; i += 1024) {
+        int_array_append_vals(array, block, MIN(1024, num_entries - i));
+    }
+    clobber(array->data);
+    end = bench_clock();
+    record_op("IntArray", "Bulk insertion (reserved, 1024 per call)", start, end, num_entries);
+    int_array_free(array);
+}
+
+// IntDeque: ints kept contiguous in data[head, head + len) with slack at
+// both ends. Popping the front only advances head, and removing in the
+// middle moves whichever side of the hole is shorter, with one memmove.
+// A queue costs O(1) per op and a random removal moves at most half the
+// elements, where GArray always moves everything behind the index.
+typedef struct {
+    int *data;
+    guint head;
+    guint len;
+    guint capacity;
+} IntDeque;
+
+static IntDeque *int_deque_new() {
+    IntDeque *deque = g_new0(IntDeque, 1);
+    return deque;
+}
+
+static void int_deque_free(IntDeque *deque) {
+    g_free(deque->data);
+    g_free(deque);
+}
+
+static inline void int_deque_push_back(IntDeque *deque, int value) {
+    if (G_UNLIKELY(deque->head + deque->len == deque->capacity)) {
+        // slide back to the start when over half the buffer is free slack
+        // in front, otherwise grow; either way amortized O(1)
+        if (deque->head >= deque->capacity / 2 && deque->head > 0) {
+            memmove(deque->data, deque->data + deque->head, deque->len * sizeof(int));
+            deque->head = 0;
+        } else {
+            deque->capacity = MAX(INT_ARRAY_MIN_CAPACITY, deque->capacity * 2);
+            deque->data = g_renew(int, deque->data, deque->capacity);
+        }
+    }
+    deque->data[deque->head + deque->len++] = value;
+}
+
+static inline void int_deque_pop_front(IntDeque *deque) {
+    deque->head++;
+    if (--deque->len == 0)
+        deque->head = 0;
+}
+
+static inline void int_deque_pop_back(IntDeque *deque) {
+    if (--deque->len == 0)
+        deque->head = 0;
+}
+
+static void int_deque_remove_range(IntDeque *deque, guint index, guint count) {
+    int *data = deque->data + deque->head;
+    if (index < deque->len - index - count) {
+        memmove(data + count, data, index * sizeof(int));
+        deque->head += count;
+    } else {
+        memmove(data + index, data + index + count,
+                (deque->len - index - count) * sizeof(int));
+    }
+    deque->len -= count;
+    if (deque->len == 0)
+        deque->head = 0;
+}
+
+static inline void int_deque_remove_index(IntDeque *deque, guint index) {
+    int_deque_remove_range(deque, index, 1);
+}
+
+static IntDeque *int_deque_filled(int n) {
+    IntDeque *deque = int_deque_new();
+    int i;
+    for (i = 0; i < n; i++)
+        int_deque_push_back(deque, i);
+    return deque;
+}
+
+// Same deletion patterns as garray_deletion_bench; only random removal
+// is still quadratic and capped
+void intdeque_bench() {
+    IntDeque *deque;
+    int i;
+    const int num_entries = workload_entries;
+    const int quadratic_entries = MIN(num_entries, QUADRATIC_ENTRIES);
+    guint64 state = 88172645463325252ULL;
+
+    deque = int_deque_filled(num_entries);
+    BenchClock start = bench_clock();
+    for (i = 0; i < num_entries; i++) {
+        int_deque_pop_back(deque);
+    }
+    BenchClock end = bench_clock();
+    record_op("IntDeque", "Deletion (tail)", start, end, num_entries);
+    int_deque_free(deque);
+
+    deque = int_deque_filled(num_entries);
+    start = bench_clock();
+    for (i = 0; i < num_entries; i++) {
+        int_deque_pop_front(deque);
+    }
+    end = bench_clock();
+    record_op("IntDeque", "Deletion (head)", start, end, num_entries);
+    int_deque_free(deque);
+
+    deque = int_deque_filled(quadratic_entries);
+    start = bench_clock();
+    for (i = 0; i < quadratic_entries; i++) {
+        int_deque_remove_index(deque, random_next(&state) % deque->len);
+    }
+    end = bench_clock();
+    record_op_sized("IntDeque", "Deletion (random index)", start, end, quadratic_entries,
+                    quadratic_entries);
+    int_deque_free(deque);
+
+    deque = int_deque_filled(num_entries);
+    start = bench_clock();
+    while (deque->len > 0) {
+        int_deque_remove_range(deque, 0, MIN(REMOVE_RANGE_BATCH, deque->len));
+    }
+    end = bench_clock();
+    record_op("IntDeque", "Deletion (remove_range from head, 1024 per call)", start, end,
+              num_entries);
+    int_deque_free(deque);
+
+    // A queue at steady state: push to the back, pop from the front
+    deque = int_deque_filled(MIN(num_entries, QUEUE_DEPTH));
+    start = bench_clock();
+    for (i = 0; i < num_entries; i++) {
+        int_deque_push_back(deque, i);
+        int_deque_pop_front(deque);
+    }
+    end = bench_clock();
+    record_op_sized("IntDeque", "Queue (push back, pop front)", start, end, num_entries,
+                    MIN(num_entries, QUEUE_DEPTH));
+    int_deque_free(deque);
+}
+
+BenchTotals glist_bench() {
     GList *list = NULL;
     int i;
-    const int num_entries = 100000000;
+    const int num_entries = workload_entries;
+    BenchTotals totals;
+    char name[64];
+    snprintf(name, sizeof(name), "GList/%s", element_allocator_name());
+    long rss_before = current_rss_kb();
 
     // Timing the insertion (prepend)
-    clock_t start = clock();
+    BenchClock start = bench_clock();
     for (i = 0; i < num_entries; i++) {
-        int *value = g_malloc(sizeof(int));
+        int *value = element_alloc(sizeof(int));
         *value = i;
         list = g_list_prepend(list, value); // Inserting at the head
     }
-    clock_t end = clock();
-    printf("GList: Insertion (prepend) time: %f seconds\n", (double)(end - start) / CLOCKS_PER_SEC);
+    BenchClock end = bench_clock();
+    totals.seconds = record_op(name, "Insertion (prepend)", start, end, num_entries);
+    totals.rss_kb = current_rss_kb() - rss_before;
 
-    // Timing the lookup (traverse the list)
-    start = clock();
+    // Timing the lookup (traverse the list), summing so it can't be dropped
+    long sum = 0;
+    int misses_fd = cache_misses_start();
+    start = bench_clock();
     GList *l;
     for (l = list; l != NULL; l = l->next) {
-        int *value = (int *)l->data;
+        sum += *(int *)l->data;
     }
-    end = clock();
-    printf("GList: Lookup (traverse) time: %f seconds\n", (double)(end - start) / CLOCKS_PER_SEC);
+    clobber(&sum);
+    end = bench_clock();
+    long long misses = cache_misses_stop(misses_fd);
+    double seconds = record_op(name, "Lookup (traverse)", start, end, num_entries);
+    print_traversal(name, seconds, num_entries, misses);
+    totals.seconds += seconds;
 
     // Timing the deletion
-    start = clock();
+    start = bench_clock();
     while (list != NULL) {
-        g_free(list->data); // Free the data
+        if (!use_arena)
+            g_free(list->data); // Free the data
         list = g_list_delete_link(list, list); // Remove the node
     }
-    end = clock();
-    printf("GList: Deletion time: %f seconds\n", (double)(end - start) / CLOCKS_PER_SEC);
+    element_release_all();
+    end = bench_clock();
+    totals.seconds += record_op(name, "Deletion", start, end, num_entries);
+    return totals;
 }
 
-void ghashtable_bench() {
+// IntChunkList: an unrolled list, each node one 64 byte cache line holding
+// up to 13 ints, so a traversal reads a line per 13 elements instead of a
+// node and a separately allocated int per element. Nodes come from
+// cache_line_alloc(), as g_malloc only aligns to 16 bytes and most nodes
+// would straddle two lines.
+#define INT_CHUNK_VALUES ((64 - sizeof(gpointer) - sizeof(guint)) / sizeof(int))
+
+typedef struct IntChunk {
+    struct IntChunk *next;
+    guint count;
+    int values[INT_CHUNK_VALUES];
+} IntChunk;
+
+static inline IntChunk *int_chunk_list_prepend(IntChunk *list, int value) {
+    if (list == NULL || list->count == INT_CHUNK_VALUES) {
+        IntChunk *chunk = cache_line_alloc(sizeof(IntChunk));
+        chunk->next = list;
+        chunk->count = 0;
+        list = chunk;
+    }
+    // the newest value of a chunk is its last one
+    list->values[list->count++] = value;
+    return list;
+}
+
+void chunklist_bench() {
+    IntChunk *list = NULL;
+    int i;
+    const int num_entries = workload_entries;
+    long rss_before = current_rss_kb();
+
+    // Timing the insertion (prepend)
+    BenchClock start = bench_clock();
+    for (i = 0; i < num_entries; i++) {
+        list = int_chunk_list_prepend(list, i);
+    }
+    BenchClock end = bench_clock();
+    record_op("IntChunkList", "Insertion (prepend)", start, end, num_entries);
+    printf("IntChunkList: RSS after insertion: +%ld KB\n", current_rss_kb() - rss_before);
+
+    // Timing the lookup (traverse the list)
+    long sum = 0;
+    int misses_fd = cache_misses_start();
+    start = bench_clock();
+    IntChunk *chunk;
+    for (chunk = list; chunk != NULL; chunk = chunk->next) {
+        guint j;
+        for (j = chunk->count; j > 0; j--)
+            sum += chunk->values[j - 1];
+    }
+    clobber(&sum);
+    end = bench_clock();
+    long long misses = cache_misses_stop(misses_fd);
+    double seconds = record_op("IntChunkList", "Lookup (traverse)", start, end, num_entries);
+    print_traversal("IntChunkList", seconds, num_entries, misses);
+
+    // Timing the deletion
+    start = bench_clock();
+    while (list != NULL) {
+        IntChunk *next = list->next;
+        free(list);
+        list = next;
+    }
+    end = bench_clock();
+    record_op("IntChunkList", "Deletion", start, end, num_entries);
+}
+
+// IntNode: an intrusive list, the value lives in the node, so there is one
+// allocation and one pointer to follow per element instead of GList's two
+typedef struct IntNode {
+    struct IntNode *next;
+    int value;
+} IntNode;
+
+void intrusivelist_bench() {
+    IntNode *list = NULL;
+    int i;
+    const int num_entries = workload_entries;
+    long rss_before = current_rss_kb();
+
+    // Timing the insertion (prepend)
+    BenchClock start = bench_clock();
+    for (i = 0; i < num_entries; i++) {
+        IntNode *node = g_malloc(sizeof(IntNode));
+        node->value = i;
+        node->next = list;
+        list = node;
+    }
+    BenchClock end = bench_clock();
+    record_op("IntNode", "Insertion (prepend)", start, end, num_entries);
+    printf("IntNode: RSS after insertion: +%ld KB\n", current_rss_kb() - rss_before);
+
+    // Timing the lookup (traverse the list)
+    long sum = 0;
+    int misses_fd = cache_misses_start();
+    start = bench_clock();
+    IntNode *node;
+    for (node = list; node != NULL; node = node->next) {
+        sum += node->value;
+    }
+    clobber(&sum);
+    end = bench_clock();
+    long long misses = cache_misses_stop(misses_fd);
+    double seconds = record_op("IntNode", "Lookup (traverse)", start, end, num_entries);
+    print_traversal("IntNode", seconds, num_entries, misses);
+
+    // Timing the deletion
+    start = bench_clock();
+    while (list != NULL) {
+        IntNode *next = list->next;
+        g_free(list);
+        list = next;
+    }
+    end = bench_clock();
+    record_op("IntNode", "Deletion", start, end, num_entries);
+}
+
+// Workloads for the keyed containers: the keys to insert and the keys to
+// look up, built before any timing starts. Key index i < count maps to an
+// inserted key and i >= count to a key that is never inserted, so misses
+// cost the same hashing and probing as hits.
+#define KEY_STRING_BYTES 16
+#define ZIPF_THETA 0.99
+
+typedef enum {
+    KEYS_SEQUENTIAL,
+    KEYS_UNIFORM,
+    KEYS_ZIPF,
+    KEYS_STRING,
+    KEY_DISTRIBUTIONS
+} KeyDistribution;
+
+static const char *key_distribution_names[KEY_DISTRIBUTIONS] = {
+    "sequential", "uniform", "zipf", "string"
+};
+
+typedef struct {
+    KeyDistribution distribution;
+    int count;
+    int *keys;    // count distinct keys in insertion order
+    int *lookups; // count lookups, lookup_hit_ratio of them inserted keys
+    // KEY_STRING_BYTES per key, only for KEYS_STRING
+    char *key_strings;
+    char *lookup_strings;
+} Workload;
+
+static Workload workload;
+// GTree and IntBTree run at half the entries, as GTree always has
+static Workload tree_workload;
+
+// Sequential keys are the index itself. The other distributions scramble
+// it with an odd multiply and an xorshift, both bijections on 31 bits, so
+// the keys stay distinct but land all over the hash space and key range.
+static inline int workload_key(KeyDistribution distribution, guint index) {
+    guint32 x;
+    if (distribution == KEYS_SEQUENTIAL)
+        return index;
+    x = (index * 0x5bd1e995u) & 0x7fffffff;
+    x ^= x >> 13;
+    return x;
+}
+
+// Zipfian ranks in [0, n) after Gray et al., "Quickly generating
+// billion-record synthetic databases": rank 0 is the most popular
+typedef struct {
+    double n, theta, alpha, zetan, eta;
+} Zipf;
+
+static void zipf_init(Zipf *zipf, int n, double theta) {
+    double zeta2 = 1.0 + pow(0.5, theta);
+    int i;
+    zipf->n = n;
+    zipf->theta = theta;
+    zipf->alpha = 1.0 / (1.0 - theta);
+    zipf->zetan = 0.0;
+    for (i = 1; i <= n; i++)
+        zipf->zetan += 1.0 / pow(i, theta);
+    zipf->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zipf->zetan);
+}
+
+static int zipf_next(const Zipf *zipf, guint64 *state) {
+    double u = (random_next(state) >> 11) * (1.0 / 9007199254740992.0);
+    double uz = u * zipf->zetan;
+    if (uz < 1.0)
+        return 0;
+    if (uz < 1.0 + pow(0.5, zipf->theta))
+        return 1;
+    int rank = zipf->n * pow(zipf->eta * u - zipf->eta + 1.0, zipf->alpha);
+    return MIN(rank, (int)zipf->n - 1);
+}
+
+static void workload_build(Workload *w, KeyDistribution distribution, int count) {
+    guint64 state = 88172645463325252ULL;
+    Zipf zipf;
+    int i;
+
+    w->distribution = distribution;
+    w->count = count;
+    w->keys = g_new(int, count);
+    w->lookups = g_new(int, count);
+    if (distribution == KEYS_ZIPF)
+        zipf_init(&zipf, count, ZIPF_THETA);
+
+    for (i = 0; i < count; i++)
+        w->keys[i] = workload_key(distribution, i);
+    for (i = 0; i < count; i++) {
+        guint index;
+        double u = (random_next(&state) >> 11) * (1.0 / 9007199254740992.0);
+        if (u >= lookup_hit_ratio)
+            index = count + random_next(&state) % count;
+        else if (distribution == KEYS_SEQUENTIAL)
+            index = i;
+        else if (distribution == KEYS_ZIPF)
+            index = zipf_next(&zipf, &state);
+        else
+            index = random_next(&state) % count;
+        w->lookups[i] = workload_key(distribution, index);
+    }
+
+    w->key_strings = NULL;
+    w->lookup_strings = NULL;
+    if (distribution == KEYS_STRING) {
+        w->key_strings = g_malloc((gsize)count * KEY_STRING_BYTES);
+        w->lookup_strings = g_malloc((gsize)count * KEY_STRING_BYTES);
+        for (i = 0; i < count; i++) {
+            snprintf(w->key_strings + (gsize)i * KEY_STRING_BYTES, KEY_STRING_BYTES, "key%d",
+                     w->keys[i]);
+            snprintf(w->lookup_strings + (gsize)i * KEY_STRING_BYTES, KEY_STRING_BYTES, "key%d",
+                     w->lookups[i]);
+        }
+    }
+}
+
+static void workload_free(Workload *w) {
+    g_free(w->keys);
+    g_free(w->lookups);
+    g_free(w->key_strings);
+    g_free(w->lookup_strings);
+    memset(w, 0, sizeof(*w));
+}
+
+static inline const char *workload_key_string(const Workload *w, int i) {
+    return w->key_strings + (gsize)i * KEY_STRING_BYTES;
+}
+
+static inline const char *workload_lookup_string(const Workload *w, int i) {
+    return w->lookup_strings + (gsize)i * KEY_STRING_BYTES;
+}
+
+BenchTotals ghashtable_bench() {
     GHashTable *hash_table;
     int i;
-    const int num_entries = 100000000;
+    const int num_entries = workload.count;
+    const gboolean strings = workload.distribution == KEYS_STRING;
+    BenchTotals totals;
+    char name[64];
+    snprintf(name, sizeof(name), "GHashTable/%s", element_allocator_name());
+    long rss_before = current_rss_kb();
 
-    // Initialize the hash table
-    hash_table = g_hash_table_new(g_int_hash, g_int_equal);
+    // Initialize the hash table; it owns g_malloc'd keys and values so
+    // destroy frees them, arena ones go in bulk afterwards
+    GDestroyNotify free_element = use_arena ? NULL : g_free;
+    hash_table = g_hash_table_new_full(strings ? g_str_hash : g_int_hash,
+                                       strings ? g_str_equal : g_int_equal, free_element,
+                                       free_element);
+    long heap_before = heap_bytes_in_use();
+    long allocations_before = allocation_count;
 
     // Timing the insertion
-    clock_t start = clock();
+    BenchClock start = bench_clock();
     for (i = 0; i < num_entries; i++) {
-        int *key = g_malloc(sizeof(int));
-        int *value = g_malloc(sizeof(int));
-        *key = i;
-        *value = i * 2;
+        gpointer key;
+        int *value = element_alloc(sizeof(int));
+        if (strings) {
+            key = element_alloc(KEY_STRING_BYTES);
+            memcpy(key, workload_key_string(&workload, i), KEY_STRING_BYTES);
+        } else {
+            key = element_alloc(sizeof(int));
+            *(int *)key = workload.keys[i];
+        }
+        *value = i;
         g_hash_table_insert(hash_table, key, value);
     }
-    clock_t end = clock();
-    printf("GHashTable: Insertion time: %f seconds\n", (double)(end - start) / CLOCKS_PER_SEC);
+    BenchClock end = bench_clock();
+    totals.seconds = record_op(name, "Insertion", start, end, num_entries);
+    printf("%s: %ld allocations, %.1f bytes per entry\n", name,
+           allocation_count - allocations_before,
+           (double)(heap_bytes_in_use() - heap_before) / num_entries);
+    totals.rss_kb = current_rss_kb() - rss_before;
 
     // Timing the lookup
-    start = clock();
+    long sum = 0;
+    start = bench_clock();
     for (i = 0; i < num_entries; i++) {
-        int key = i;
-        g_hash_table_lookup(hash_table, &key);
+        int key = workload.lookups[i];
+        int *value = g_hash_table_lookup(hash_table,
+                                         strings ? (gconstpointer)workload_lookup_string(&workload, i)
+                                                 : (gconstpointer)&key);
+        if (value != NULL)
+            sum += *value;
     }
-    end = clock();
-    printf("GHashTable: Lookup time: %f seconds\n", (double)(end - start) / CLOCKS_PER_SEC);
+    clobber(&sum);
+    end = bench_clock();
+    totals.seconds += record_op(name, "Lookup", start, end, num_entries);
 
     // Free the memory
     g_hash_table_destroy(hash_table);
+    element_release_all();
+    return totals;
 }
 
-void gtree_bench() {
+// IntMap: an open addressing int -> int map in the style of SwissTable.
+// Slots come in aligned groups of 16, each with a control byte that holds
+// the top 7 bits of the key's hash, or EMPTY/DELETED. A probe compares all
+// 16 control bytes of a group with one SSE2 compare and only looks at keys
+// whose byte matched. Keys and values are stored inline, so inserting
+// allocates nothing but the occasional rehash and lookups chase no pointers.
+#define INT_MAP_GROUP 16
+#define INT_MAP_EMPTY ((signed char)-128)
+#define INT_MAP_DELETED ((signed char)-2)
+
+typedef struct {
+    int key;
+    int value;
+} IntMapSlot;
+
+typedef struct {
+    signed char *ctrl;
+    IntMapSlot *slots;
+    guint capacity; // power of two, at least one group
+    guint size;
+    guint tombstones;
+} IntMap;
+
+static inline guint64 int_map_hash(int key) {
+    guint64 h = (guint64)(guint32)key * 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 32);
+}
+
+// Bit i set where control byte i of the group equals byte
+static inline guint int_map_match(const signed char *group, signed char byte) {
+#ifdef __SSE2__
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(byte)));
+#else
+    guint mask = 0;
+    int i;
+    for (i = 0; i < INT_MAP_GROUP; i++)
+        mask |= (guint)(group[i] == byte) << i;
+    return mask;
+#endif
+}
+
+// Bit i set where slot i of the group is EMPTY or DELETED (sign bit set)
+static inline guint int_map_match_free(const signed char *group) {
+#ifdef __SSE2__
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+#else
+    guint mask = 0;
+    int i;
+    for (i = 0; i < INT_MAP_GROUP; i++)
+        mask |= (guint)(group[i] < 0) << i;
+    return mask;
+#endif
+}
+
+static void int_map_init(IntMap *map, guint capacity) {
+    guint cap = INT_MAP_GROUP;
+    while (cap < capacity)
+        cap *= 2;
+    map->ctrl = g_malloc(cap);
+    memset(map->ctrl, INT_MAP_EMPTY, cap);
+    map->slots = g_new(IntMapSlot, cap);
+    map->capacity = cap;
+    map->size = 0;
+    map->tombstones = 0;
+}
+
+static void int_map_destroy(IntMap *map) {
+    g_free(map->ctrl);
+    g_free(map->slots);
+}
+
+// Slot holding key, or -1. Groups are probed in triangular order, which
+// visits every group of a power of two table; an EMPTY slot ends the probe.
+static inline long int_map_find_slot(const IntMap *map, int key) {
+    guint64 hash = int_map_hash(key);
+    signed char h2 = hash >> 57;
+    guint group_mask = map->capacity / INT_MAP_GROUP - 1;
+    guint group = hash & group_mask;
+    guint step;
+    for (step = 1; ; step++) {
+        const signed char *ctrl = map->ctrl + group * INT_MAP_GROUP;
+        guint match = int_map_match(ctrl, h2);
+        while (match) {
+            guint slot = group * INT_MAP_GROUP + __builtin_ctz(match);
+            if (G_LIKELY(map->slots[slot].key == key))
+                return slot;
+            match &= match - 1;
+        }
+        if (int_map_match(ctrl, INT_MAP_EMPTY))
+            return -1;
+        group = (group + step) & group_mask;
+    }
+}
+
+static inline gboolean int_map_lookup(const IntMap *map, int key, int *value) {
+    long slot = int_map_find_slot(map, key);
+    if (slot < 0)
+        return FALSE;
+    *value = map->slots[slot].value;
+    return TRUE;
+}
+
+// First EMPTY or DELETED slot on key's probe sequence
+static inline guint int_map_free_slot(const IntMap *map, guint64 hash) {
+    guint group_mask = map->capacity / INT_MAP_GROUP - 1;
+    guint group = hash & group_mask;
+    guint step;
+    for (step = 1; ; step++) {
+        guint free_slots = int_map_match_free(map->ctrl + group * INT_MAP_GROUP);
+        if (free_slots)
+            return group * INT_MAP_GROUP + __builtin_ctz(free_slots);
+        group = (group + step) & group_mask;
+    }
+}
+
+static void int_map_rehash(IntMap *map, guint capacity) {
+    IntMap old = *map;
+    guint i;
+    int_map_init(map, capacity);
+    for (i = 0; i < old.capacity; i++) {
+        if (old.ctrl[i] >= 0) {
+            guint64 hash = int_map_hash(old.slots[i].key);
+            guint slot = int_map_free_slot(map, hash);
+            map->ctrl[slot] = hash >> 57;
+            map->slots[slot] = old.slots[i];
+            map->size++;
+        }
+    }
+    int_map_destroy(&old);
+}
+
+// Insert or replace. Grows at 7/8 full; a table clogged with tombstones is
+// rebuilt at the same size instead.
+static inline void int_map_insert(IntMap *map, int key, int value) {
+    long found = int_map_find_slot(map, key);
+    if (found >= 0) {
+        map->slots[found].value = value;
+        return;
+    }
+    if (G_UNLIKELY((map->size + map->tombstones + 1) * 8 > map->capacity * 7))
+        int_map_rehash(map, map->size * 2 >= map->capacity ? map->capacity * 2 : map->capacity);
+
+    guint64 hash = int_map_hash(key);
+    guint slot = int_map_free_slot(map, hash);
+    if (map->ctrl[slot] == INT_MAP_DELETED)
+        map->tombstones--;
+    map->ctrl[slot] = hash >> 57;
+    map->slots[slot].key = key;
+    map->slots[slot].value = value;
+    map->size++;
+}
+
+// A group that still has an EMPTY slot never made a probe move on, so the
+// removed slot can go back to EMPTY; otherwise it has to stay a tombstone.
+static inline gboolean int_map_remove(IntMap *map, int key) {
+    long slot = int_map_find_slot(map, key);
+    if (slot < 0)
+        return FALSE;
+    const signed char *group = map->ctrl + (slot & ~(long)(INT_MAP_GROUP - 1));
+    if (int_map_match(group, INT_MAP_EMPTY)) {
+        map->ctrl[slot] = INT_MAP_EMPTY;
+    } else {
+        map->ctrl[slot] = INT_MAP_DELETED;
+        map->tombstones++;
+    }
+    map->size--;
+    return TRUE;
+}
+
+void intmap_bench() {
+    IntMap map;
+    int i;
+    const int num_entries = workload.count;
+
+    if (workload.distribution == KEYS_STRING) {
+        printf("IntMap: int keys only, skipped for string keys\n");
+        return;
+    }
+
+    long heap_before = heap_bytes_in_use();
+    long allocations_before = allocation_count;
+    int_map_init(&map, 0);
+
+    // Timing the insertion
+    BenchClock start = bench_clock();
+    for (i = 0; i < num_entries; i++) {
+        int_map_insert(&map, workload.keys[i], i);
+    }
+    BenchClock end = bench_clock();
+    record_op("IntMap", "Insertion", start, end, num_entries);
+    printf("IntMap: %ld allocations, %.1f bytes per entry\n",
+           allocation_count - allocations_before,
+           (double)(heap_bytes_in_use() - heap_before) / num_entries);
+
+    // Timing the lookup
+    long sum = 0;
+    start = bench_clock();
+    for (i = 0; i < num_entries; i++) {
+        int value;
+        if (int_map_lookup(&map, workload.lookups[i], &value))
+            sum += value;
+    }
+    clobber(&sum);
+    end = bench_clock();
+    record_op("IntMap", "Lookup", start, end, num_entries);
+
+    int_map_destroy(&map);
+}
+
+#define RANGE_SCAN_KEYS 100
+
+gint compare_strings_data(gconstpointer a, gconstpointer b, gpointer user_data) {
+    return strcmp(a, b);
+}
+
+BenchTotals gtree_bench() {
     GTree *tree;
     int i;
-    const int num_entries = 50000000;
+    const Workload *w = &tree_workload;
+    const int num_entries = w->count;
+    const gboolean strings = w->distribution == KEYS_STRING;
+    BenchTotals totals;
+    char name[64];
+    snprintf(name, sizeof(name), "GTree/%s", element_allocator_name());
+    long rss_before = current_rss_kb();
 
-    // Initialize the GTree
-    tree = g_tree_new(compare_ints);
+    // Initialize the GTree; like the hash table it frees g_malloc'd keys
+    // and values itself
+    GDestroyNotify free_element = use_arena ? NULL : g_free;
+    tree = g_tree_new_full(strings ? compare_strings_data : compare_ints_data, NULL, free_element,
+                           free_element);
 
     // Timing the insertion
-    clock_t start = clock();
+    BenchClock start = bench_clock();
     for (i = 0; i < num_entries; i++) {
-        int *key = g_malloc(sizeof(int));
-        int *value = g_malloc(sizeof(int));
-        *key = i;
-        *value = i * 2;
+        gpointer key;
+        int *value = element_alloc(sizeof(int));
+        if (strings) {
+            key = element_alloc(KEY_STRING_BYTES);
+            memcpy(key, workload_key_string(w, i), KEY_STRING_BYTES);
+        } else {
+            key = element_alloc(sizeof(int));
+            *(int *)key = w->keys[i];
+        }
+        *value = i;
         g_tree_insert(tree, key, value);
     }
-    clock_t end = clock();
-    printf("GTree: Insertion time: %f seconds\n", (double)(end - start) / CLOCKS_PER_SEC);
+    BenchClock end = bench_clock();
+    totals.seconds = record_op(name, "Insertion", start, end, num_entries);
+    totals.rss_kb = current_rss_kb() - rss_before;
 
     // Timing the lookup
-    start = clock();
+    long sum = 0;
+    start = bench_clock();
     for (i = 0; i < num_entries; i++) {
-        int key = i;
-        g_tree_lookup(tree, &key);
+        int key = w->lookups[i];
+        int *value = g_tree_lookup(tree, strings ? (gconstpointer)workload_lookup_string(w, i)
+                                                 : (gconstpointer)&key);
+        if (value != NULL)
+            sum += *value;
+    }
+    clobber(&sum);
+    end = bench_clock();
+    totals.seconds += record_op(name, "Lookup", start, end, num_entries);
+
+#if GLIB_CHECK_VERSION(2, 68, 0)
+    // Timing ordered range scans from the first lookup keys, reported per
+    // key visited
+    long visited = 0;
+    start = bench_clock();
+    for (i = 0; i < MAX(1, num_entries / RANGE_SCAN_KEYS); i++) {
+        int key = w->lookups[i];
+        GTreeNode *node = g_tree_lower_bound(tree, strings ? (gconstpointer)workload_lookup_string(w, i)
+                                                           : (gconstpointer)&key);
+        int n;
+        for (n = 0; n < RANGE_SCAN_KEYS && node != NULL; n++) {
+            sum += *(int *)g_tree_node_value(node);
+            node = g_tree_node_next(node);
+        }
+        visited += n;
     }
-    end = clock();
-    printf("GTree: Lookup time: %f seconds\n", (double)(end - start) / CLOCKS_PER_SEC);
+    clobber(&sum);
+    end = bench_clock();
+    totals.seconds += record_op(name, "Range scan", start, end, visited);
+#else
+    printf("%s: Range scan needs GLib 2.68 for g_tree_lower_bound, skipped\n", name);
+#endif
 
     // Timing the deletion
-    start = clock();
+    start = bench_clock();
     for (i = 0; i < num_entries; i++) {
-        int key = i;
-        g_tree_remove(tree, &key);
+        int key = w->keys[i];
+        g_tree_remove(tree, strings ? (gconstpointer)workload_key_string(w, i) : (gconstpointer)&key);
     }
-    end = clock();
-    printf("GTree: Deletion time: %f seconds\n", (double)(end - start) / CLOCKS_PER_SEC);
+    end = bench_clock();
+    totals.seconds += record_op(name, "Deletion", start, end, num_entries);
 
     // Destroy the tree
     g_tree_destroy(tree);
+    element_release_all();
+    return totals;
+}
+
+// IntBTree: a B+tree of int -> int. Nodes hold up to 32 keys searched with
+// a linear scan over a few cache lines, values live only in the leaves and
+// the leaves are chained, so a range scan is a walk along one array after
+// another. Every node has one spare slot, so an insert can overflow it
+// first and split afterwards.
+#define BTREE_MAX_KEYS 32
+#define BTREE_MIN_KEYS (BTREE_MAX_KEYS / 2)
+
+typedef struct BTreeNode {
+    guint count;
+    gboolean leaf;
+    int keys[BTREE_MAX_KEYS + 1];
+    union {
+        struct BTreeNode *children[BTREE_MAX_KEYS + 2];
+        struct {
+            int values[BTREE_MAX_KEYS + 1];
+            struct BTreeNode *next;
+        } leaf;
+    } u;
+} BTreeNode;
+
+typedef struct {
+    BTreeNode *root;
+} IntBTree;
+
+static BTreeNode *btree_node_new(gboolean leaf) {
+    BTreeNode *node = g_new(BTreeNode, 1);
+    node->count = 0;
+    node->leaf = leaf;
+    if (leaf)
+        node->u.leaf.next = NULL;
+    return node;
+}
+
+// Number of keys <= key, which is the child to descend into
+static inline guint btree_upper_bound(const BTreeNode *node, int key) {
+    guint i, n = 0;
+    for (i = 0; i < node->count; i++)
+        n += node->keys[i] <= key;
+    return n;
+}
+
+// Number of keys < key, the position of key in a leaf
+static inline guint btree_lower_bound(const BTreeNode *node, int key) {
+    guint i, n = 0;
+    for (i = 0; i < node->count; i++)
+        n += node->keys[i] < key;
+    return n;
+}
+
+static void btree_init(IntBTree *tree) {
+    tree->root = btree_node_new(TRUE);
+}
+
+static void btree_free_node(BTreeNode *node) {
+    guint i;
+    if (!node->leaf) {
+        for (i = 0; i <= node->count; i++)
+            btree_free_node(node->u.children[i]);
+    }
+    g_free(node);
+}
+
+static void btree_destroy(IntBTree *tree) {
+    btree_free_node(tree->root);
+    tree->root = NULL;
+}
+
+static inline const BTreeNode *btree_find_leaf(const IntBTree *tree, int key) {
+    const BTreeNode *node = tree->root;
+    while (!node->leaf)
+        node = node->u.children[btree_upper_bound(node, key)];
+    return node;
+}
+
+static inline gboolean btree_lookup(const IntBTree *tree, int key, int *value) {
+    const BTreeNode *leaf = btree_find_leaf(tree, key);
+    guint pos = btree_lower_bound(leaf, key);
+    if (pos == leaf->count || leaf->keys[pos] != key)
+        return FALSE;
+    *value = leaf->u.leaf.values[pos];
+    return TRUE;
+}
+
+// Split an overfull node in two; returns the new right half and the key
+// that separates it from node in the parent
+static BTreeNode *btree_split(BTreeNode *node, int *separator) {
+    BTreeNode *right = btree_node_new(node->leaf);
+    if (node->leaf) {
+        guint keep = node->count / 2;
+        right->count = node->count - keep;
+        memcpy(right->keys, node->keys + keep, right->count * sizeof(int));
+        memcpy(right->u.leaf.values, node->u.leaf.values + keep, right->count * sizeof(int));
+        right->u.leaf.next = node->u.leaf.next;
+        node->u.leaf.next = right;
+        node->count = keep;
+        *separator = right->keys[0];
+    } else {
+        // the middle key moves up instead of being copied
+        guint mid = node->count / 2;
+        right->count = node->count - mid - 1;
+        memcpy(right->keys, node->keys + mid + 1, right->count * sizeof(int));
+        memcpy(right->u.children, node->u.children + mid + 1,
+               (right->count + 1) * sizeof(BTreeNode *));
+        node->count = mid;
+        *separator = node->keys[mid];
+    }
+    return right;
+}
+
+// Returns the new right sibling if node overflowed and split
+static BTreeNode *btree_insert_node(BTreeNode *node, int key, int value, int *separator) {
+    if (node->leaf) {
+        guint pos = btree_lower_bound(node, key);
+        if (pos < node->count && node->keys[pos] == key) {
+            node->u.leaf.values[pos] = value;
+            return NULL;
+        }
+        memmove(node->keys + pos + 1, node->keys + pos, (node->count - pos) * sizeof(int));
+        memmove(node->u.leaf.values + pos + 1, node->u.leaf.values + pos,
+                (node->count - pos) * sizeof(int));
+        node->keys[pos] = key;
+        node->u.leaf.values[pos] = value;
+        node->count++;
+    } else {
+        guint idx = btree_upper_bound(node, key);
+        int child_separator;
+        BTreeNode *right = btree_insert_node(node->u.children[idx], key, value, &child_separator);
+        if (right == NULL)
+            return NULL;
+        memmove(node->keys + idx + 1, node->keys + idx, (node->count - idx) * sizeof(int));
+        memmove(node->u.children + idx + 2, node->u.children + idx + 1,
+                (node->count - idx) * sizeof(BTreeNode *));
+        node->keys[idx] = child_separator;
+        node->u.children[idx + 1] = right;
+        node->count++;
+    }
+    return node->count > BTREE_MAX_KEYS ? btree_split(node, separator) : NULL;
+}
+
+static void btree_insert(IntBTree *tree, int key, int value) {
+    int separator;
+    BTreeNode *right = btree_insert_node(tree->root, key, value, &separator);
+    if (right != NULL) {
+        BTreeNode *root = btree_node_new(FALSE);
+        root->count = 1;
+        root->keys[0] = separator;
+        root->u.children[0] = tree->root;
+        root->u.children[1] = right;
+        tree->root = root;
+    }
+}
+
+// Remove key and child idx + 1 from an internal node
+static void btree_remove_child(BTreeNode *node, guint idx) {
+    memmove(node->keys + idx, node->keys + idx + 1, (node->count - idx - 1) * sizeof(int));
+    memmove(node->u.children + idx + 1, node->u.children + idx + 2,
+            (node->count - idx - 1) * sizeof(BTreeNode *));
+    node->count--;
+}
+
+// Child idx of parent dropped below the minimum: borrow a key from a
+// sibling that can spare one, otherwise merge it with a sibling
+static void btree_fix_underflow(BTreeNode *parent, guint idx) {
+    BTreeNode *child = parent->u.children[idx];
+    BTreeNode *left = idx > 0 ? parent->u.children[idx - 1] : NULL;
+    BTreeNode *right = idx < parent->count ? parent->u.children[idx + 1] : NULL;
+
+    if (left != NULL && left->count > BTREE_MIN_KEYS) {
+        memmove(child->keys + 1, child->keys, child->count * sizeof(int));
+        if (child->leaf) {
+            memmove(child->u.leaf.values + 1, child->u.leaf.values, child->count * sizeof(int));
+            child->keys[0] = left->keys[left->count - 1];
+            child->u.leaf.values[0] = left->u.leaf.values[left->count - 1];
+            parent->keys[idx - 1] = child->keys[0];
+        } else {
+            memmove(child->u.children + 1, child->u.children,
+                    (child->count + 1) * sizeof(BTreeNode *));
+            child->keys[0] = parent->keys[idx - 1];
+            child->u.children[0] = left->u.children[left->count];
+            parent->keys[idx - 1] = left->keys[left->count - 1];
+        }
+        child->count++;
+        left->count--;
+    } else if (right != NULL && right->count > BTREE_MIN_KEYS) {
+        if (child->leaf) {
+            child->keys[child->count] = right->keys[0];
+            child->u.leaf.values[child->count] = right->u.leaf.values[0];
+            memmove(right->u.leaf.values, right->u.leaf.values + 1,
+                    (right->count - 1) * sizeof(int));
+            memmove(right->keys, right->keys + 1, (right->count - 1) * sizeof(int));
+            parent->keys[idx] = right->keys[0];
+        } else {
+            child->keys[child->count] = parent->keys[idx];
+            child->u.children[child->count + 1] = right->u.children[0];
+            parent->keys[idx] = right->keys[0];
+            memmove(right->keys, right->keys + 1, (right->count - 1) * sizeof(int));
+            memmove(right->u.children, right->u.children + 1, right->count * sizeof(BTreeNode *));
+        }
+        child->count++;
+        right->count--;
+    } else {
+        // merge the pair at sep into its left node
+        guint sep = left != NULL ? idx - 1 : idx;
+        BTreeNode *a = parent->u.children[sep];
+        BTreeNode *b = parent->u.children[sep + 1];
+        if (a->leaf) {
+            memcpy(a->keys + a->count, b->keys, b->count * sizeof(int));
+            memcpy(a->u.leaf.values + a->count, b->u.leaf.values, b->count * sizeof(int));
+            a->count += b->count;
+            a->u.leaf.next = b->u.leaf.next;
+        } else {
+            a->keys[a->count] = parent->keys[sep];
+            memcpy(a->keys + a->count + 1, b->keys, b->count * sizeof(int));
+            memcpy(a->u.children + a->count + 1, b->u.children,
+                   (b->count + 1) * sizeof(BTreeNode *));
+            a->count += 1 + b->count;
+        }
+        g_free(b);
+        btree_remove_child(parent, sep);
+    }
+}
+
+static gboolean btree_remove_node(BTreeNode *node, int key) {
+    if (node->leaf) {
+        guint pos = btree_lower_bound(node, key);
+        if (pos == node->count || node->keys[pos] != key)
+            return FALSE;
+        memmove(node->keys + pos, node->keys + pos + 1, (node->count - pos - 1) * sizeof(int));
+        memmove(node->u.leaf.values + pos, node->u.leaf.values + pos + 1,
+                (node->count - pos - 1) * sizeof(int));
+        node->count--;
+        return TRUE;
+    }
+    guint idx = btree_upper_bound(node, key);
+    if (!btree_remove_node(node->u.children[idx], key))
+        return FALSE;
+    if (node->u.children[idx]->count < BTREE_MIN_KEYS)
+        btree_fix_underflow(node, idx);
+    return TRUE;
+}
+
+static gboolean btree_remove(IntBTree *tree, int key) {
+    gboolean removed = btree_remove_node(tree->root, key);
+    if (!tree->root->leaf && tree->root->count == 0) {
+        BTreeNode *old = tree->root;
+        tree->root = old->u.children[0];
+        g_free(old);
+    }
+    return removed;
+}
+
+BenchTotals btree_bench() {
+    IntBTree tree;
+    int i;
+    const Workload *w = &tree_workload;
+    const int num_entries = w->count;
+    BenchTotals totals = { 0.0, 0 };
+    const char *name = "IntBTree";
+    long rss_before = current_rss_kb();
+
+    if (w->distribution == KEYS_STRING) {
+        printf("%s: int keys only, skipped for string keys\n", name);
+        return totals;
+    }
+
+    btree_init(&tree);
+
+    // Timing the insertion
+    BenchClock start = bench_clock();
+    for (i = 0; i < num_entries; i++) {
+        btree_insert(&tree, w->keys[i], i);
+    }
+    BenchClock end = bench_clock();
+    totals.seconds = record_op(name, "Insertion", start, end, num_entries);
+    totals.rss_kb = current_rss_kb() - rss_before;
+    printf("%s: RSS after insertion: +%ld KB\n", name, totals.rss_kb);
+
+    // Timing the lookup
+    long sum = 0;
+    start = bench_clock();
+    for (i = 0; i < num_entries; i++) {
+        int value;
+        if (btree_lookup(&tree, w->lookups[i], &value))
+            sum += value;
+    }
+    clobber(&sum);
+    end = bench_clock();
+    totals.seconds += record_op(name, "Lookup", start, end, num_entries);
+
+    // Timing ordered range scans from the first lookup keys, reported per
+    // key visited
+    long visited = 0;
+    start = bench_clock();
+    for (i = 0; i < MAX(1, num_entries / RANGE_SCAN_KEYS); i++) {
+        int key = w->lookups[i];
+        const BTreeNode *leaf = btree_find_leaf(&tree, key);
+        guint pos = btree_lower_bound(leaf, key);
+        int n = 0;
+        while (leaf != NULL && n < RANGE_SCAN_KEYS) {
+            for (; pos < leaf->count && n < RANGE_SCAN_KEYS; pos++, n++)
+                sum += leaf->u.leaf.values[pos];
+            leaf = leaf->u.leaf.next;
+            pos = 0;
+        }
+        visited += n;
+    }
+    clobber(&sum);
+    end = bench_clock();
+    totals.seconds += record_op(name, "Range scan", start, end, visited);
+
+    // Timing the deletion
+    start = bench_clock();
+    for (i = 0; i < num_entries; i++) {
+        btree_remove(&tree, w->keys[i]);
+    }
+    end = bench_clock();
+    totals.seconds += record_op(name, "Deletion", start, end, num_entries);
+
+    btree_destroy(&tree);
+    return totals;
+}
+
+// Concurrent maps: N threads run the same mixed insert/lookup/delete
+// workload against one shared int -> int map. Each implementation fills in
+// a ConcurrentMap, so the driver is the same for all of them.
+#define CONCURRENT_KEYS (1 << 20)
+#define CONCURRENT_OPS_PER_THREAD 4000000
+#define CONCURRENT_LOOKUP_PCT 80
+
+typedef struct {
+    const char *name;
+    gpointer (*create)(void);
+    void (*destroy)(gpointer map);
+    gboolean (*lookup)(gpointer map, int key, int *value);
+    void (*insert)(gpointer map, int key, int value);
+    void (*remove)(gpointer map, int key);
+} ConcurrentMap;
+
+// GHashTable behind one global GMutex, the way our services share them.
+// Keys and values are stored with GINT_TO_POINTER so the table itself is
+// the only thing that allocates.
+typedef struct {
+    GMutex lock;
+    GHashTable *table;
+} LockedHashTable;
+
+static gpointer locked_table_create(void) {
+    LockedHashTable *map = g_new(LockedHashTable, 1);
+    g_mutex_init(&map->lock);
+    map->table = g_hash_table_new(g_direct_hash, g_direct_equal);
+    return map;
+}
+
+static void locked_table_destroy(gpointer data) {
+    LockedHashTable *map = data;
+    g_hash_table_destroy(map->table);
+    g_mutex_clear(&map->lock);
+    g_free(map);
+}
+
+static gboolean locked_table_lookup(gpointer data, int key, int *value) {
+    LockedHashTable *map = data;
+    gpointer found;
+    g_mutex_lock(&map->lock);
+    gboolean present = g_hash_table_lookup_extended(map->table, GINT_TO_POINTER(key), NULL, &found);
+    g_mutex_unlock(&map->lock);
+    if (present)
+        *value = GPOINTER_TO_INT(found);
+    return present;
+}
+
+static void locked_table_insert(gpointer data, int key, int value) {
+    LockedHashTable *map = data;
+    g_mutex_lock(&map->lock);
+    g_hash_table_insert(map->table, GINT_TO_POINTER(key), GINT_TO_POINTER(value));
+    g_mutex_unlock(&map->lock);
+}
+
+static void locked_table_remove(gpointer data, int key) {
+    LockedHashTable *map = data;
+    g_mutex_lock(&map->lock);
+    g_hash_table_remove(map->table, GINT_TO_POINTER(key));
+    g_mutex_unlock(&map->lock);
+}
+
+// The same GHashTable split into 64 stripes, each with its own lock and
+// on its own cache line, so threads only contend when they hit the same
+// stripe
+#define MAP_STRIPES 64
+
+typedef struct {
+    GMutex lock;
+    GHashTable *table;
+} __attribute__((aligned(64))) MapStripe;
+
+typedef struct {
+    MapStripe stripes[MAP_STRIPES];
+} StripedHashTable;
+
+static inline MapStripe *striped_table_stripe(StripedHashTable *map, int key) {
+    return &map->stripes[((guint)key * 2654435761u) >> 26];
+}
+
+static gpointer striped_table_create(void) {
+    StripedHashTable *map = cache_line_alloc(sizeof(StripedHashTable));
+    int i;
+    for (i = 0; i < MAP_STRIPES; i++) {
+        g_mutex_init(&map->stripes[i].lock);
+        map->stripes[i].table = g_hash_table_new(g_direct_hash, g_direct_equal);
+    }
+    return map;
+}
+
+static void striped_table_destroy(gpointer data) {
+    StripedHashTable *map = data;
+    int i;
+    for (i = 0; i < MAP_STRIPES; i++) {
+        g_hash_table_destroy(map->stripes[i].table);
+        g_mutex_clear(&map->stripes[i].lock);
+    }
+    free(map);
 }
 
-int main() {
+static gboolean striped_table_lookup(gpointer data, int key, int *value) {
+    MapStripe *stripe = striped_table_stripe(data, key);
+    gpointer found;
+    g_mutex_lock(&stripe->lock);
+    gboolean present = g_hash_table_lookup_extended(stripe->table, GINT_TO_POINTER(key), NULL, &found);
+    g_mutex_unlock(&stripe->lock);
+    if (present)
+        *value = GPOINTER_TO_INT(found);
+    return present;
+}
+
+static void striped_table_insert(gpointer data, int key, int value) {
+    MapStripe *stripe = striped_table_stripe(data, key);
+    g_mutex_lock(&stripe->lock);
+    g_hash_table_insert(stripe->table, GINT_TO_POINTER(key), GINT_TO_POINTER(value));
+    g_mutex_unlock(&stripe->lock);
+}
+
+static void striped_table_remove(gpointer data, int key) {
+    MapStripe *stripe = striped_table_stripe(data, key);
+    g_mutex_lock(&stripe->lock);
+    g_hash_table_remove(stripe->table, GINT_TO_POINTER(key));
+    g_mutex_unlock(&stripe->lock);
+}
+
+// Lock-free open addressing map for read-mostly use. A slot's key is
+// claimed once with a CAS and never given back; removing a key only marks
+// its value absent. Lookups are plain atomic loads, so readers never write
+// a shared cache line. The price is a fixed capacity sized for the whole
+// key space, which CONCURRENT_KEYS bounds here.
+#define LOCKFREE_CAPACITY (CONCURRENT_KEYS * 2)
+#define LOCKFREE_EMPTY_KEY -1
+#define LOCKFREE_ABSENT G_MININT
+
+typedef struct {
+    gint key;
+    gint value;
+} LockFreeSlot;
+
+typedef struct {
+    LockFreeSlot *slots;
+} LockFreeMap;
+
+static gpointer lockfree_map_create(void) {
+    LockFreeMap *map = g_new(LockFreeMap, 1);
+    int i;
+    map->slots = g_new(LockFreeSlot, LOCKFREE_CAPACITY);
+    for (i = 0; i < LOCKFREE_CAPACITY; i++) {
+        map->slots[i].key = LOCKFREE_EMPTY_KEY;
+        map->slots[i].value = LOCKFREE_ABSENT;
+    }
+    return map;
+}
+
+static void lockfree_map_destroy(gpointer data) {
+    LockFreeMap *map = data;
+    g_free(map->slots);
+    g_free(map);
+}
+
+static inline guint lockfree_map_home(int key) {
+    return ((guint)key * 2654435761u) & (LOCKFREE_CAPACITY - 1);
+}
 
-    garray_bench();
-    glist_bench();
-    ghashtable_bench();
-    //gtree_bench();
+static gboolean lockfree_map_lookup(gpointer data, int key, int *value) {
+    LockFreeMap *map = data;
+    guint i;
+    for (i = lockfree_map_home(key);; i = (i + 1) & (LOCKFREE_CAPACITY - 1)) {
+        gint slot_key = g_atomic_int_get(&map->slots[i].key);
+        if (slot_key == key) {
+            gint found = g_atomic_int_get(&map->slots[i].value);
+            if (found == LOCKFREE_ABSENT)
+                return FALSE;
+            *value = found;
+            return TRUE;
+        }
+        if (slot_key == LOCKFREE_EMPTY_KEY)
+            return FALSE;
+    }
+}
+
+static void lockfree_map_insert(gpointer data, int key, int value) {
+    LockFreeMap *map = data;
+    guint i;
+    for (i = lockfree_map_home(key);; i = (i + 1) & (LOCKFREE_CAPACITY - 1)) {
+        gint slot_key = g_atomic_int_get(&map->slots[i].key);
+        if (slot_key == LOCKFREE_EMPTY_KEY) {
+            // claim the slot; if another thread won it, look at what it wrote
+            if (!g_atomic_int_compare_and_exchange(&map->slots[i].key, LOCKFREE_EMPTY_KEY, key))
+                slot_key = g_atomic_int_get(&map->slots[i].key);
+            else
+                slot_key = key;
+        }
+        if (slot_key == key) {
+            g_atomic_int_set(&map->slots[i].value, value);
+            return;
+        }
+    }
+}
+
+static void lockfree_map_remove(gpointer data, int key) {
+    LockFreeMap *map = data;
+    guint i;
+    for (i = lockfree_map_home(key);; i = (i + 1) & (LOCKFREE_CAPACITY - 1)) {
+        gint slot_key = g_atomic_int_get(&map->slots[i].key);
+        if (slot_key == key) {
+            g_atomic_int_set(&map->slots[i].value, LOCKFREE_ABSENT);
+            return;
+        }
+        if (slot_key == LOCKFREE_EMPTY_KEY)
+            return;
+    }
+}
+
+static const ConcurrentMap concurrent_maps[] = {
+    { "GHashTable+GMutex", locked_table_create, locked_table_destroy,
+      locked_table_lookup, locked_table_insert, locked_table_remove },
+    { "StripedHashTable", striped_table_create, striped_table_destroy,
+      striped_table_lookup, striped_table_insert, striped_table_remove },
+    { "LockFreeMap", lockfree_map_create, lockfree_map_destroy,
+      lockfree_map_lookup, lockfree_map_insert, lockfree_map_remove },
+};
+
+typedef struct {
+    const ConcurrentMap *impl;
+    gpointer map;
+    guint64 seed;
+    volatile gint *go;
+    long hits;
+} ConcurrentWorker;
+
+static gpointer concurrent_worker(gpointer data) {
+    ConcurrentWorker *worker = data;
+    const ConcurrentMap *impl = worker->impl;
+    guint64 state = worker->seed;
+    long hits = 0;
+    int i;
+
+    // all threads start together once the main thread opens the gate
+    while (!g_atomic_int_get(worker->go))
+        g_thread_yield();
+
+    for (i = 0; i < CONCURRENT_OPS_PER_THREAD; i++) {
+        guint64 r = random_next(&state);
+        int key = r % CONCURRENT_KEYS;
+        guint op = (r >> 32) % 100;
+        int value;
+        if (op < CONCURRENT_LOOKUP_PCT)
+            hits += impl->lookup(worker->map, key, &value);
+        else if (op % 2 == 0)
+            impl->insert(worker->map, key, key * 2);
+        else
+            impl->remove(worker->map, key);
+    }
+    worker->hits = hits;
+    return NULL;
+}
+
+// Throughput of one map at one thread count, with half the keys preloaded
+static double concurrent_run(const ConcurrentMap *impl, int num_threads) {
+    gpointer map = impl->create();
+    ConcurrentWorker *workers = g_new0(ConcurrentWorker, num_threads);
+    GThread **threads = g_new(GThread *, num_threads);
+    volatile gint go = 0;
+    long hits = 0;
+    int i;
+
+    for (i = 0; i < CONCURRENT_KEYS; i += 2)
+        impl->insert(map, i, i * 2);
+
+    for (i = 0; i < num_threads; i++) {
+        workers[i].impl = impl;
+        workers[i].map = map;
+        workers[i].seed = 0x9E3779B97F4A7C15ULL * (i + 1);
+        workers[i].go = &go;
+        threads[i] = g_thread_new("concurrent", concurrent_worker, &workers[i]);
+    }
+
+    BenchClock start = bench_clock();
+    g_atomic_int_set(&go, 1);
+    for (i = 0; i < num_threads; i++) {
+        g_thread_join(threads[i]);
+        hits += workers[i].hits;
+    }
+    BenchClock end = bench_clock();
+    clobber(&hits);
+
+    long total_ops = (long)num_threads * CONCURRENT_OPS_PER_THREAD;
+    char op[64];
+    snprintf(op, sizeof(op), "Mixed %d%% lookup, %d thread%s", CONCURRENT_LOOKUP_PCT,
+             num_threads, num_threads == 1 ? "" : "s");
+    double seconds = record_op(impl->name, op, start, end, total_ops);
+
+    g_free(threads);
+    g_free(workers);
+    impl->destroy(map);
+    return total_ops / seconds / 1e6;
+}
+
+// Throughput versus thread count for every map, doubling the threads up
+// to twice the cpu count so oversubscription shows too
+void concurrent_bench() {
+    const int num_maps = sizeof(concurrent_maps) / sizeof(concurrent_maps[0]);
+    int max_threads = 2 * g_get_num_processors();
+    int m, threads;
+
+    if (max_threads < 4)
+        max_threads = 4;
+    for (m = 0; m < num_maps; m++) {
+        double single = 0.0;
+        for (threads = 1; threads <= max_threads; threads *= 2) {
+            double mops = concurrent_run(&concurrent_maps[m], threads);
+            if (threads == 1)
+                single = mops;
+            else
+                printf("%s: %d threads scale %.2fx over 1 thread\n",
+                       concurrent_maps[m].name, threads, mops / single);
+        }
+    }
+}
+
+// Small-object churn: every thread keeps a working set of live objects of
+// 8 to 64 bytes and replaces a random one per op, freeing it and
+// allocating a new one of a random size. The same pattern runs through
+// GSlice, g_malloc, a bump arena that never reuses anything, and a
+// per-size free-list pool.
+#define CHURN_LIVE_OBJECTS (1 << 20)
+#define CHURN_MAX_BYTES 64
+
+// SizeClassPool: one LIFO free list per 8-byte size class, refilled by
+// carving from an arena. That is GSlice's idea without the magazines and
+// the depot: nothing is shared, so each thread owns a pool.
+#define POOL_CLASS_BYTES 8
+#define POOL_CLASSES (CHURN_MAX_BYTES / POOL_CLASS_BYTES)
+
+typedef struct PoolObject {
+    struct PoolObject *next;
+} PoolObject;
+
+typedef struct {
+    PoolObject *free[POOL_CLASSES];
+    Arena blocks;
+} SizeClassPool;
+
+static inline gpointer pool_alloc(SizeClassPool *pool, gsize size) {
+    guint size_class = (size - 1) / POOL_CLASS_BYTES;
+    PoolObject *object = pool->free[size_class];
+    if (G_LIKELY(object != NULL)) {
+        pool->free[size_class] = object->next;
+        return object;
+    }
+    return arena_alloc(&pool->blocks, (size_class + 1) * POOL_CLASS_BYTES);
+}
+
+static inline void pool_free(SizeClassPool *pool, gpointer p, gsize size) {
+    guint size_class = (size - 1) / POOL_CLASS_BYTES;
+    PoolObject *object = p;
+    object->next = pool->free[size_class];
+    pool->free[size_class] = object;
+}
+
+typedef enum {
+    CHURN_GSLICE,
+    CHURN_GMALLOC,
+    CHURN_ARENA,
+    CHURN_POOL,
+    CHURN_ALLOCATORS
+} ChurnAllocator;
+
+static const char *churn_allocator_names[CHURN_ALLOCATORS] = {
+    "GSlice", "g_malloc", "Arena", "SizeClassPool"
+};
+
+typedef struct {
+    ChurnAllocator allocator;
+    int live;
+    long ops;
+    gpointer *objects;
+    guint8 *sizes;
+    Arena arena;
+    SizeClassPool pool;
+    guint64 seed;
+    volatile gint *ready;
+    volatile gint *go;
+} ChurnWorker;
+
+static inline gpointer churn_alloc(ChurnWorker *worker, gsize size) {
+    switch (worker->allocator) {
+    case CHURN_GSLICE:
+        return g_slice_alloc(size);
+    case CHURN_GMALLOC:
+        return g_malloc(size);
+    case CHURN_ARENA:
+        return arena_alloc(&worker->arena, size);
+    default:
+        return pool_alloc(&worker->pool, size);
+    }
+}
+
+static inline void churn_free(ChurnWorker *worker, gpointer p, gsize size) {
+    switch (worker->allocator) {
+    case CHURN_GSLICE:
+        g_slice_free1(size, p);
+        break;
+    case CHURN_GMALLOC:
+        g_free(p);
+        break;
+    case CHURN_ARENA:
+        // a bump arena can't reuse anything before it is freed in bulk
+        break;
+    default:
+        pool_free(&worker->pool, p, size);
+        break;
+    }
+}
+
+static gpointer churn_worker(gpointer data) {
+    ChurnWorker *worker = data;
+    guint64 state = worker->seed;
+    long i;
+
+    for (i = 0; i < worker->live; i++) {
+        gsize size = POOL_CLASS_BYTES * (1 + random_next(&state) % POOL_CLASSES);
+        worker->sizes[i] = size;
+        worker->objects[i] = churn_alloc(worker, size);
+        *(long *)worker->objects[i] = i;
+    }
+
+    g_atomic_int_inc(worker->ready);
+    while (!g_atomic_int_get(worker->go))
+        g_thread_yield();
+
+    for (i = 0; i < worker->ops; i++) {
+        guint64 r = random_next(&state);
+        int slot = r % worker->live;
+        gsize size = POOL_CLASS_BYTES * (1 + (r >> 32) % POOL_CLASSES);
+        churn_free(worker, worker->objects[slot], worker->sizes[slot]);
+        worker->sizes[slot] = size;
+        worker->objects[slot] = churn_alloc(worker, size);
+        *(long *)worker->objects[slot] = i;
+    }
+    return NULL;
+}
+
+// What run_isolated() runs next
+static ChurnAllocator churn_allocator;
+static int churn_threads;
+
+// The same total number of ops split over churn_threads threads, each
+// with its own working set, pool and arena
+static BenchTotals churn_run() {
+    const int num_entries = workload_entries;
+    const int live = MIN(num_entries, CHURN_LIVE_OBJECTS);
+    ChurnWorker *workers = g_new0(ChurnWorker, churn_threads);
+    GThread **threads = g_new(GThread *, churn_threads);
+    volatile gint ready = 0;
+    volatile gint go = 0;
+    BenchTotals totals;
+    char name[64];
+    char op[64];
+    int t, i;
+
+    snprintf(name, sizeof(name), "Churn/%s", churn_allocator_names[churn_allocator]);
+    snprintf(op, sizeof(op), "Free+alloc, 8-64 bytes, %d thread%s", churn_threads,
+             churn_threads == 1 ? "" : "s");
+    long rss_before = current_rss_kb();
+
+    for (t = 0; t < churn_threads; t++) {
+        workers[t].allocator = churn_allocator;
+        workers[t].live = live;
+        workers[t].ops = num_entries / churn_threads;
+        workers[t].objects = g_new(gpointer, live);
+        workers[t].sizes = g_new(guint8, live);
+        workers[t].seed = 0x9E3779B97F4A7C15ULL * (t + 1);
+        workers[t].ready = &ready;
+        workers[t].go = &go;
+        threads[t] = g_thread_new("churn", churn_worker, &workers[t]);
+    }
+    while (g_atomic_int_get(&ready) < churn_threads)
+        g_thread_yield();
+
+    BenchClock start = bench_clock();
+    g_atomic_int_set(&go, 1);
+    for (t = 0; t < churn_threads; t++)
+        g_thread_join(threads[t]);
+    BenchClock end = bench_clock();
+    totals.seconds = record_op(name, op, start, end, (long)workers[0].ops * churn_threads);
+    totals.rss_kb = current_rss_kb() - rss_before;
+    printf("%s: RSS with %d live objects per thread: +%ld KB\n", name, live, totals.rss_kb);
+
+    for (t = 0; t < churn_threads; t++) {
+        ChurnWorker *worker = &workers[t];
+        for (i = 0; i < live; i++)
+            churn_free(worker, worker->objects[i], worker->sizes[i]);
+        arena_free_all(&worker->arena);
+        arena_free_all(&worker->pool.blocks);
+        g_free(worker->objects);
+        g_free(worker->sizes);
+    }
+    g_free(threads);
+    g_free(workers);
+    return totals;
+}
+
+// Every allocator on one thread and on as many threads as there are cpus
+// (at least two), each in its own process so RSS starts from a clean heap
+void churn_bench() {
+    int thread_counts[2] = { 1, MAX(2, (int)g_get_num_processors()) };
+    int a, c;
+
+    if (glib_check_version(2, 76, 0) == NULL)
+        printf("Churn: GLib %u.%u routes GSlice to g_malloc\n", glib_major_version,
+               glib_minor_version);
+    for (c = 0; c < 2; c++) {
+        churn_threads = thread_counts[c];
+        for (a = 0; a < CHURN_ALLOCATORS; a++) {
+            churn_allocator = a;
+            run_isolated(churn_run);
+        }
+    }
+}
+
+// One pass over the benchmarks for the current workload. The ones without
+// keys only run when keyless is set, once per size; the concurrent maps
+// have a fixed key space of their own and only run once per repetition.
+static void run_suite(gboolean keyless, gboolean concurrent) {
+    current_keys = NULL;
+    if (keyless) {
+        garray_bench();
+        intarray_bench();
+        garray_deletion_bench();
+        intdeque_bench();
+        printf("Peak RSS: %ld KB\n", peak_rss_kb());
+        compare_element_allocators("GList", glist_bench);
+        chunklist_bench();
+        intrusivelist_bench();
+        churn_bench();
+    }
+    current_keys = key_distribution_names[workload.distribution];
+    compare_element_allocators("GHashTable", ghashtable_bench);
+    intmap_bench();
+    compare_element_allocators("GTree", gtree_bench);
+    run_isolated(btree_bench);
+    current_keys = NULL;
+    if (concurrent)
+        concurrent_bench();
+}
+
+static void json_string(FILE *out, const char *text) {
+    fputc('"', out);
+    for (; *text != '\0'; text++) {
+        if (*text == '"' || *text == '\\')
+            fprintf(out, "\\%c", *text);
+        else if ((unsigned char)*text < 0x20)
+            fprintf(out, "\\u%04x", *text);
+        else
+            fputc(*text, out);
+    }
+    fputc('"', out);
+}
+
+// json has no inf or nan
+static void json_number(FILE *out, double value) {
+    if (isfinite(value))
+        fprintf(out, "%.9g", value);
+    else
+        fprintf(out, "null");
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double median_of_sorted(const double *values, int count) {
+    if (count % 2 == 1)
+        return values[count / 2];
+    return (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+// One record per container/operation, size and key distribution, with the
+// ns/op of every repetition and their min/median/mean/max, in the same
+// layout as memtest --json
+static void write_json(FILE *out, int argc, char **argv, int warmup, int reps) {
+    int count = MIN(op_log->count, MAX_OP_RECORDS);
+    gboolean *done = g_new0(gboolean, count);
+    double *wall = g_new(double, count);
+    double *cpu = g_new(double, count);
+    struct utsname uts;
+    const char *separator = "";
+    int i, j;
+
+    fprintf(out, "{\n  \"schema\": \"malloc-glib-results/1\",\n  \"args\": [");
+    for (i = 1; i < argc; i++) {
+        fprintf(out, "%s", i > 1 ? ", " : "");
+        json_string(out, argv[i]);
+    }
+    fprintf(out, "],\n  \"host\": {\n    \"cpus\": %u,\n    \"page_size\": %ld,\n    \"kernel\": ",
+            g_get_num_processors(), sysconf(_SC_PAGESIZE));
+    json_string(out, uname(&uts) == 0 ? uts.release : "");
+#ifdef __GLIBC__
+    fprintf(out, ",\n    \"libc\": \"glibc %s\"", gnu_get_libc_version());
+#endif
+    fprintf(out, ",\n    \"compiler\": ");
+    json_string(out, __VERSION__);
+    fprintf(out, ",\n    \"glib_compiled\": \"%d.%d.%d\",\n    \"glib_runtime\": \"%u.%u.%u\"\n  },\n",
+            GLIB_MAJOR_VERSION, GLIB_MINOR_VERSION, GLIB_MICRO_VERSION, glib_major_version,
+            glib_minor_version, glib_micro_version);
+    fprintf(out, "  \"warmup\": %d,\n  \"reps\": %d,\n  \"hit_ratio\": ", warmup, reps);
+    json_number(out, lookup_hit_ratio);
+    fprintf(out, ",\n  \"results\": [");
+
+    for (i = 0; i < count; i++) {
+        const OpRecord *first = &op_log->records[i];
+        long peak = 0;
+        int samples = 0;
+        double sum = 0.0;
+        if (done[i])
+            continue;
+        for (j = i; j < count; j++) {
+            const OpRecord *record = &op_log->records[j];
+            if (done[j] || strcmp(record->container, first->container) != 0 ||
+                strcmp(record->op, first->op) != 0 || strcmp(record->keys, first->keys) != 0 ||
+                record->entries != first->entries)
+                continue;
+            done[j] = TRUE;
+            wall[samples] = record->wall_seconds * 1e9 / record->ops;
+            cpu[samples] = record->cpu_seconds * 1e9 / record->ops;
+            sum += wall[samples];
+            peak = MAX(peak, record->peak_rss_kb);
+            samples++;
+        }
+
+        // values stay in run order, the stats come from a sorted copy
+        fprintf(out, "%s\n    {\"container\": ", separator);
+        json_string(out, first->container);
+        fprintf(out, ", \"op\": ");
+        json_string(out, first->op);
+        fprintf(out, ", \"entries\": %d, \"keys\": ", first->entries);
+        if (first->keys[0] != '\0')
+            json_string(out, first->keys);
+        else
+            fprintf(out, "null");
+        fprintf(out, ", \"unit\": \"ns/op\", \"ops\": %ld, \"samples\": %d, \"values\": [",
+                first->ops, samples);
+        for (j = 0; j < samples; j++) {
+            fprintf(out, "%s", j > 0 ? ", " : "");
+            json_number(out, wall[j]);
+        }
+        fprintf(out, "]");
+        qsort(wall, samples, sizeof(double), compare_doubles);
+        qsort(cpu, samples, sizeof(double), compare_doubles);
+        fprintf(out, ", \"min\": ");
+        json_number(out, wall[0]);
+        fprintf(out, ", \"median\": ");
+        json_number(out, median_of_sorted(wall, samples));
+        fprintf(out, ", \"mean\": ");
+        json_number(out, sum / samples);
+        fprintf(out, ", \"max\": ");
+        json_number(out, wall[samples - 1]);
+        fprintf(out, ", \"cpu_median\": ");
+        json_number(out, median_of_sorted(cpu, samples));
+        fprintf(out, ", \"peak_rss_kb\": %ld}", peak);
+        separator = ",";
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    g_free(cpu);
+    g_free(wall);
+    g_free(done);
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s [--entries N,...|--sweep] [--keys DIST,...|all] [--hit-ratio F]\n"
+            "          [--warmup N] [--reps N] [--json PATH|-]\n"
+            "  --entries N,...  elements per container, K/M suffixes allowed (default 100M,\n"
+            "                   GTree and IntBTree take half)\n"
+            "  --sweep          same as --entries 1K,10K,100K,1M,10M,100M\n"
+            "  --keys DIST,...  sequential, uniform, zipf or string (default sequential,uniform)\n"
+            "  --hit-ratio F    fraction of lookups that find their key (default 1.0)\n"
+            "  --warmup N       passes over the whole suite first that are not recorded (default 0)\n"
+            "  --reps N         timed passes over the whole suite (default 1)\n"
+            "  --json PATH      write one record per container/operation; - writes it to\n"
+            "                   stdout and moves the usual text to stderr\n",
+            argv0);
+}
+
+// Comma separated counts like 1K,10M; returns how many were parsed or -1
+static int parse_entries(const char *text, int *entries, int max) {
+    int count = 0;
+    while (*text != '\0') {
+        char *rest;
+        long value = strtol(text, &rest, 10);
+        if (*rest == 'K' || *rest == 'k') {
+            value *= 1000;
+            rest++;
+        } else if (*rest == 'M' || *rest == 'm') {
+            value *= 1000000;
+            rest++;
+        }
+        // keys for misses come from the index range above the entries
+        if (rest == text || value < 2 || value > G_MAXINT / 2 || count == max)
+            return -1;
+        entries[count++] = value;
+        if (*rest == ',')
+            rest++;
+        else if (*rest != '\0')
+            return -1;
+        text = rest;
+    }
+    return count;
+}
+
+// Comma separated distribution names or "all"; returns how many or -1
+static int parse_keys(const char *text, KeyDistribution *keys) {
+    gchar **names = g_strsplit(text, ",", -1);
+    int count = 0;
+    int i, d;
+    if (strcmp(text, "all") == 0) {
+        for (d = 0; d < KEY_DISTRIBUTIONS; d++)
+            keys[count++] = d;
+    } else {
+        for (i = 0; names[i] != NULL; i++) {
+            for (d = 0; d < KEY_DISTRIBUTIONS; d++) {
+                if (strcmp(names[i], key_distribution_names[d]) == 0)
+                    break;
+            }
+            if (d == KEY_DISTRIBUTIONS || count == KEY_DISTRIBUTIONS) {
+                count = -1;
+                break;
+            }
+            keys[count++] = d;
+        }
+    }
+    g_strfreev(names);
+    return count;
+}
+
+#define MAX_SIZES 32
+
+int main(int argc, char **argv) {
+    // the full suite at 100M elements takes minutes, so one pass is the default
+    int warmup = 0;
+    int reps = 1;
+    const char *json_path = NULL;
+    int sizes[MAX_SIZES] = { 100000000 };
+    int num_sizes = 1;
+    KeyDistribution keys[KEY_DISTRIBUTIONS] = { KEYS_SEQUENTIAL, KEYS_UNIFORM };
+    int num_keys = 2;
+    int i, s, d;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+            reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (strcmp(argv[i], "--entries") == 0 && i + 1 < argc) {
+            num_sizes = parse_entries(argv[++i], sizes, MAX_SIZES);
+        } else if (strcmp(argv[i], "--sweep") == 0) {
+            num_sizes = parse_entries("1K,10K,100K,1M,10M,100M", sizes, MAX_SIZES);
+        } else if (strcmp(argv[i], "--keys") == 0 && i + 1 < argc) {
+            num_keys = parse_keys(argv[++i], keys);
+        } else if (strcmp(argv[i], "--hit-ratio") == 0 && i + 1 < argc) {
+            lookup_hit_ratio = atof(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (warmup < 0 || reps < 1 || num_sizes < 1 || num_keys < 1 || lookup_hit_ratio < 0.0 ||
+        lookup_hit_ratio > 1.0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // with --json - the report owns stdout and the usual text goes to stderr,
+    // forked benchmark children included
+    FILE *json_stdout = NULL;
+    if (json_path != NULL && strcmp(json_path, "-") == 0) {
+        int fd = dup(STDOUT_FILENO);
+        json_stdout = fd >= 0 ? fdopen(fd, "w") : NULL;
+        if (json_stdout == NULL || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+            fprintf(stderr, "ERROR: cannot move the text output to stderr\n");
+            return 1;
+        }
+    }
+
+    op_log = mmap(NULL, sizeof(OpRecordLog), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                  -1, 0);
+    if (op_log == MAP_FAILED) {
+        fprintf(stderr, "ERROR: mmap of the result log failed\n");
+        return 1;
+    }
+
+    for (s = 0; s < num_sizes; s++) {
+        workload_entries = sizes[s];
+        for (d = 0; d < num_keys; d++) {
+            workload_build(&workload, keys[d], workload_entries);
+            workload_build(&tree_workload, keys[d], workload_entries / 2);
+            for (current_repetition = -warmup; current_repetition < reps; current_repetition++) {
+                printf("### %d entries, %s keys, %g%% lookup hits", workload_entries,
+                       key_distribution_names[keys[d]], lookup_hit_ratio * 100);
+                if (current_repetition < 0)
+                    printf(", warmup %d/%d", current_repetition + warmup + 1, warmup);
+                else if (reps > 1)
+                    printf(", repetition %d/%d", current_repetition + 1, reps);
+                printf("\n");
+                run_suite(d == 0, s == 0 && d == 0);
+            }
+            workload_free(&workload);
+            workload_free(&tree_workload);
+        }
+    }
+
+    if (op_log->count > MAX_OP_RECORDS)
+        fprintf(stderr, "WARNING: only the first %d of %d results are in the json\n",
+                MAX_OP_RECORDS, op_log->count);
+    if (json_path != NULL) {
+        FILE *out = json_stdout != NULL ? json_stdout : fopen(json_path, "w");
+        if (out == NULL) {
+            fprintf(stderr, "ERROR: cannot write %s\n", json_path);
+            return 1;
+        }
+        fflush(stdout);
+        write_json(out, argc, argv, warmup, reps);
+        fclose(out);
+    }
+    munmap(op_log, sizeof(OpRecordLog));
 
     return 0;
 }
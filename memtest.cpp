@@ -1,90 +1,4155 @@
-// g++ -std=c++0x -Wall -O2 -DNDEBUG -o memtest memtest.cpp
+// g++ -std=c++0x -Wall -O2 -DNDEBUG -pthread -o memtest memtest.cpp
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <cerrno>
 #include <cstring>
 #include <iostream>
 #include <cstdint>
+#include <fstream>
+#include <map>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define MEMTEST_X86 1
+#endif
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef __GLIBC__
+#include <gnu/libc-version.h>
+#endif
+
+/////////////
+// clock
+//
+// Every timed region reads nowNs(). It is backed by steady_clock, or with
+// --tsc by the time stamp counter calibrated against steady_clock once, which
+// is cheaper to read and has cycle resolution.
+
+struct TscClock
+{
+  bool enabled;
+  std::uint64_t baseTicks;
+  double nsPerTick;
+};
+
+TscClock& tscClock()
+{
+  static TscClock clock = { false, 0, 0.0 };
+  return clock;
+}
+
+std::uint64_t steadyNowNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#ifdef MEMTEST_X86
+inline std::uint64_t readTsc()
+{
+  // keep earlier loads from drifting past the timestamp
+  _mm_lfence();
+  std::uint64_t ticks = __rdtsc();
+  _mm_lfence();
+  return ticks;
+}
+#endif
+
+// switch nowNs() over to the tsc; false if it isn't invariant across
+// frequency changes and sleep states, in which case steady_clock stays
+bool enableTscClock()
+{
+#ifdef MEMTEST_X86
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+  if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1u << 8)))
+  {
+    return false;
+  }
+
+  std::uint64_t ns_start = steadyNowNs();
+  std::uint64_t tsc_start = readTsc();
+  while (steadyNowNs() - ns_start < 50000000)
+  {
+  }
+  std::uint64_t ns_stop = steadyNowNs();
+  std::uint64_t tsc_stop = readTsc();
+
+  TscClock& clock = tscClock();
+  clock.baseTicks = tsc_start;
+  clock.nsPerTick = double(ns_stop - ns_start) / double(tsc_stop - tsc_start);
+  clock.enabled = true;
+  return true;
+#else
+  return false;
+#endif
+}
+
+inline std::uint64_t nowNs()
+{
+#ifdef MEMTEST_X86
+  const TscClock& clock = tscClock();
+  if (clock.enabled)
+  {
+    return (std::uint64_t)((readTsc() - clock.baseTicks) * clock.nsPerTick);
+  }
+#endif
+  return steadyNowNs();
+}
 
 class Timer
 {
  public:
   Timer()
-      : mStart(),
-        mStop()
+      : mStart(0),
+        mStop(0)
+  {
+    update();
+  }
+
+  void update()
+  {
+    mStart = nowNs();
+    mStop  = mStart;
+  }
+
+  std::uint64_t elapsedNs()
+  {
+    mStop = nowNs();
+    return mStop - mStart;
+  }
+
+  double elapsedMs()
+  {
+    return elapsedNs() / 1.0e6;
+  }
+
+  double elapsedSec()
+  {
+    return elapsedNs() / 1.0e9;
+  }
+
+ private:
+  std::uint64_t mStart;
+  std::uint64_t mStop;
+};
+
+std::string formatBytes(std::uint64_t bytes)
+{
+  static const int num_suffix = 5;
+  static const char* suffix[num_suffix] = { "B", "KB", "MB", "GB", "TB" };
+  double dbl_s_byte = bytes;
+  int i = 0;
+  for (; (int)(bytes / 1024.) > 0 && i < num_suffix;
+       ++i, bytes /= 1024.)
+  {
+    dbl_s_byte = bytes / 1024.0;
+  }
+
+  const int buf_len = 64;
+  char buf[buf_len];
+
+  // use snprintf so there is no buffer overrun
+  int res = snprintf(buf, buf_len,"%0.2f%s", dbl_s_byte, suffix[i]);
+
+  // snprintf returns number of characters that would have been written if n had
+  //       been sufficiently large, not counting the terminating null character.
+  //       if an encoding error occurs, a negative number is returned.
+  if (res >= 0)
+  {
+    return std::string(buf);
+  }
+  return std::string();
+}
+
+std::string formatRate(std::uint64_t bytes, double seconds)
+{
+  if (seconds <= 0.0)
+  {
+    return std::string("n/a");
+  }
+  return formatBytes(bytes / seconds) + "/s";
+}
+
+void doMemmove(void* pDest, const void* pSource, std::size_t sizeBytes)
+{
+  memmove(pDest, pSource, sizeBytes);
+}
+
+// stop the compiler from assuming the buffer contents are dead between
+// repeated calls
+inline void clobberMemory(void* p)
+{
+  asm volatile("" : : "r"(p) : "memory");
+}
+
+/////////////
+// hardware counters
+//
+// With --perf, measure() and the lockstep runner also read perf_event_open
+// counters around their timed repetitions and attach them to the stats, per
+// sample. The per-process counters are inherited by threads created later,
+// so lockstep workers are included. Whatever the kernel refuses (no PMU in a
+// VM, perf_event_paranoid, no uncore access) is left out and named once.
+
+enum CounterId
+{
+  CTR_CYCLES,
+  CTR_INSTRUCTIONS,
+  CTR_LLC_MISSES,
+  CTR_DTLB_MISSES,
+  CTR_PAGE_FAULTS,
+  CTR_DRAM_READ_BYTES,
+  CTR_DRAM_WRITE_BYTES,
+  CTR_COUNT
+};
+
+const char* counterName(int id)
+{
+  static const char* names[CTR_COUNT] = {
+    "cycles", "instructions", "llc_misses", "dtlb_misses", "page_faults",
+    "dram_read_bytes", "dram_write_bytes"
+  };
+  return names[id];
+}
+
+struct CounterSample
+{
+  bool valid[CTR_COUNT];
+  double value[CTR_COUNT];
+};
+
+struct PerfCounter
+{
+  int id;
+  int fd;
+  // raw count to reported unit, e.g. cas operations to bytes
+  double scale;
+};
+
+std::vector<PerfCounter>& perfCounters()
+{
+  static std::vector<PerfCounter> counters;
+  return counters;
+}
+
+int openPerfEvent(std::uint32_t type, std::uint64_t config, int pid, int cpu, bool inherit)
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.inherit = inherit ? 1 : 0;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  int fd = syscall(SYS_perf_event_open, &attr, pid, cpu, -1, 0);
+  if (fd < 0 && pid >= 0)
+  {
+    // perf_event_paranoid 2 still allows counting user space only
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = syscall(SYS_perf_event_open, &attr, pid, cpu, -1, 0);
+  }
+  return fd;
+}
+
+std::string readSysfs(const std::string& path)
+{
+  std::ifstream file(path.c_str());
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+// cpus of a sysfs cpu list like "0,28" or "0-3,8"
+std::vector<int> parseCpuList(const std::string& list)
+{
+  std::vector<int> cpus;
+  std::stringstream ranges(list);
+  std::string range;
+  while (std::getline(ranges, range, ','))
+  {
+    int first = 0;
+    int last = 0;
+    int fields = sscanf(range.c_str(), "%d-%d", &first, &last);
+    if (fields < 1)
+    {
+      continue;
+    }
+    if (fields == 1)
+    {
+      last = first;
+    }
+    for (int cpu = first; cpu <= last; ++cpu)
+    {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+// turns an event spec like "event=0x04,umask=0x03" into a config value
+// using the pmu's format files ("config:0-7")
+bool uncoreConfig(const std::string& pmu, const std::string& spec, std::uint64_t& config)
+{
+  config = 0;
+  std::stringstream terms(spec);
+  std::string term;
+  while (std::getline(terms, term, ','))
+  {
+    std::size_t eq = term.find('=');
+    std::uint64_t value =
+        eq == std::string::npos ? 1 : strtoull(term.c_str() + eq + 1, NULL, 0);
+    std::string format = readSysfs(pmu + "/format/" + term.substr(0, eq));
+    unsigned int lo = 0;
+    unsigned int hi = 0;
+    int fields = sscanf(format.c_str(), "config:%u-%u", &lo, &hi);
+    if (fields < 1)
+    {
+      return false;
+    }
+    if (fields == 1)
+    {
+      hi = lo;
+    }
+    std::uint64_t mask = hi - lo >= 63 ? ~0ULL : (1ULL << (hi - lo + 1)) - 1;
+    config |= (value & mask) << lo;
+  }
+  return true;
+}
+
+// system wide cas counts of every integrated memory controller, so what
+// other processes do shows up here too. The pmu's cpumask lists one cpu
+// per socket; each socket's controllers are opened on its cpu and the
+// counts add up by id. Returns how many opened.
+int openUncoreImc()
+{
+  static const std::string root = "/sys/bus/event_source/devices/";
+  int opened = 0;
+  DIR* p_dir = opendir(root.c_str());
+  if (p_dir == NULL)
+  {
+    return 0;
+  }
+  while (struct dirent* p_entry = readdir(p_dir))
+  {
+    const std::string name = p_entry->d_name;
+    if (name.compare(0, 10, "uncore_imc") != 0)
+    {
+      continue;
+    }
+    const std::string pmu = root + name;
+    const std::uint32_t type = strtoul(readSysfs(pmu + "/type").c_str(), NULL, 10);
+    const std::vector<int> cpus = parseCpuList(readSysfs(pmu + "/cpumask"));
+
+    const struct { const char* event; int id; } events[] = {
+      { "cas_count_read", CTR_DRAM_READ_BYTES },
+      { "cas_count_write", CTR_DRAM_WRITE_BYTES },
+    };
+    for (std::size_t e = 0; e < sizeof(events) / sizeof(events[0]); ++e)
+    {
+      const std::string event = pmu + "/events/" + events[e].event;
+      std::uint64_t config = 0;
+      if (!uncoreConfig(pmu, readSysfs(event), config))
+      {
+        continue;
+      }
+      // one cas moves a 64 byte line; the scale file says so in MiB
+      double scale = atof(readSysfs(event + ".scale").c_str());
+      scale = readSysfs(event + ".unit") == "MiB" ? scale * 1048576.0 : 64.0;
+
+      for (std::size_t c = 0; c < cpus.size(); ++c)
+      {
+        int fd = openPerfEvent(type, config, -1, cpus[c], false);
+        if (fd >= 0)
+        {
+          PerfCounter counter = { events[e].id, fd, scale };
+          perfCounters().push_back(counter);
+          ++opened;
+        }
+      }
+    }
+  }
+  closedir(p_dir);
+  return opened;
+}
+
+// opens what it can; false if nothing at all could be counted
+bool openPerfCounters()
+{
+  const struct { int id; std::uint32_t type; std::uint64_t config; } core[] = {
+    { CTR_CYCLES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { CTR_INSTRUCTIONS, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { CTR_LLC_MISSES, PERF_TYPE_HW_CACHE,
+      PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { CTR_DTLB_MISSES, PERF_TYPE_HW_CACHE,
+      PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { CTR_PAGE_FAULTS, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+  };
+
+  std::string missing;
+  for (std::size_t c = 0; c < sizeof(core) / sizeof(core[0]); ++c)
+  {
+    int fd = openPerfEvent(core[c].type, core[c].config, 0, -1, true);
+    if (fd >= 0)
+    {
+      PerfCounter counter = { core[c].id, fd, 1.0 };
+      perfCounters().push_back(counter);
+    }
+    else
+    {
+      missing += std::string(missing.empty() ? "" : ", ") + counterName(core[c].id);
+    }
+  }
+  if (openUncoreImc() == 0)
+  {
+    missing += std::string(missing.empty() ? "" : ", ") + "dram bandwidth (uncore_imc)";
+  }
+
+  if (!missing.empty())
+  {
+    std::cerr << "NOTE: perf counters not available: " << missing
+              << " (see /proc/sys/kernel/perf_event_paranoid)" << std::endl;
+  }
+  return !perfCounters().empty();
+}
+
+// current totals, scaled up when the kernel had to multiplex the counters
+CounterSample counterSnapshot()
+{
+  CounterSample sample;
+  for (int id = 0; id < CTR_COUNT; ++id)
+  {
+    sample.valid[id] = false;
+    sample.value[id] = 0.0;
+  }
+
+  const std::vector<PerfCounter>& counters = perfCounters();
+  for (std::size_t c = 0; c < counters.size(); ++c)
+  {
+    // value, time enabled, time running
+    std::uint64_t data[3];
+    if (::read(counters[c].fd, data, sizeof(data)) == (ssize_t)sizeof(data) && data[2] > 0)
+    {
+      sample.value[counters[c].id] +=
+          data[0] * ((double)data[1] / data[2]) * counters[c].scale;
+      sample.valid[counters[c].id] = true;
+    }
+  }
+  return sample;
+}
+
+// counts from before to after, divided over divisor samples
+CounterSample counterDelta(const CounterSample& before, const CounterSample& after,
+                           double divisor)
+{
+  CounterSample delta;
+  for (int id = 0; id < CTR_COUNT; ++id)
+  {
+    delta.valid[id] = before.valid[id] && after.valid[id];
+    delta.value[id] = delta.valid[id] ? (after.value[id] - before.value[id]) / divisor : 0.0;
+  }
+  return delta;
+}
+
+CounterSample scaleCounters(CounterSample sample, double divisor)
+{
+  for (int id = 0; id < CTR_COUNT; ++id)
+  {
+    sample.value[id] /= divisor;
+  }
+  return sample;
+}
+
+bool hasCounters(const CounterSample& sample)
+{
+  for (int id = 0; id < CTR_COUNT; ++id)
+  {
+    if (sample.valid[id])
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string formatCounters(const CounterSample& sample)
+{
+  std::ostringstream out;
+  const char* separator = "";
+  for (int id = 0; id < CTR_COUNT; ++id)
+  {
+    if (!sample.valid[id])
+    {
+      continue;
+    }
+    out << separator << counterName(id) << " ";
+    if (id == CTR_DRAM_READ_BYTES || id == CTR_DRAM_WRITE_BYTES)
+    {
+      out << formatBytes(sample.value[id]);
+    }
+    else
+    {
+      out << sample.value[id];
+    }
+    separator = ", ";
+  }
+  if (sample.valid[CTR_CYCLES] && sample.valid[CTR_INSTRUCTIONS] &&
+      sample.value[CTR_CYCLES] > 0.0)
+  {
+    out << ", ipc " << sample.value[CTR_INSTRUCTIONS] / sample.value[CTR_CYCLES];
+  }
+  return out.str();
+}
+
+// extra CSV columns, one per counter, only once --perf opened any; counters
+// that are not available stay empty
+std::string counterCsvHeader()
+{
+  std::string header;
+  if (perfCounters().empty())
+  {
+    return header;
+  }
+  for (int id = 0; id < CTR_COUNT; ++id)
+  {
+    header += std::string(",") + counterName(id);
+  }
+  return header;
+}
+
+std::string counterCsvFields(const CounterSample& sample)
+{
+  std::ostringstream out;
+  if (perfCounters().empty())
+  {
+    return out.str();
+  }
+  for (int id = 0; id < CTR_COUNT; ++id)
+  {
+    out << ",";
+    if (sample.valid[id])
+    {
+      out << sample.value[id];
+    }
+  }
+  return out.str();
+}
+
+/////////////
+// measurement harness
+//
+// measure() runs an operation warmup times untimed and then reps times
+// timed, and summarizes the samples. Statistics are in seconds unless the
+// caller summarizes something else, like bandwidths.
+
+struct Harness
+{
+  int warmup;
+  int reps;
+};
+
+struct Stats
+{
+  int samples;
+  double min;
+  double median;
+  double p95;
+  double p99;
+  double max;
+  double mean;
+  double stddev;
+  // the samples themselves, sorted
+  std::vector<double> values;
+  // perf counters per sample, with --perf
+  CounterSample counters;
+};
+
+// linear interpolation between the closest ranks of a sorted sample
+double percentile(const std::vector<double>& sorted, double p)
+{
+  if (sorted.empty())
+  {
+    return 0.0;
+  }
+  double rank = p / 100.0 * (sorted.size() - 1);
+  std::size_t lower = (std::size_t)rank;
+  if (lower + 1 >= sorted.size())
+  {
+    return sorted.back();
+  }
+  double frac = rank - lower;
+  return sorted[lower] + frac * (sorted[lower + 1] - sorted[lower]);
+}
+
+Stats summarize(std::vector<double> samples)
+{
+  Stats stats = Stats();
+  stats.samples = (int)samples.size();
+  if (samples.empty())
+  {
+    return stats;
+  }
+
+  std::sort(samples.begin(), samples.end());
+  double sum = 0.0;
+  for (std::size_t i = 0; i < samples.size(); ++i)
+  {
+    sum += samples[i];
+  }
+  stats.mean = sum / samples.size();
+  double var = 0.0;
+  for (std::size_t i = 0; i < samples.size(); ++i)
+  {
+    var += (samples[i] - stats.mean) * (samples[i] - stats.mean);
+  }
+  stats.stddev = samples.size() > 1 ? std::sqrt(var / (samples.size() - 1)) : 0.0;
+  stats.min = samples.front();
+  stats.max = samples.back();
+  stats.median = percentile(samples, 50.0);
+  stats.p95 = percentile(samples, 95.0);
+  stats.p99 = percentile(samples, 99.0);
+  stats.values.swap(samples);
+  return stats;
+}
+
+template <typename Fn>
+Stats measure(const Harness& harness, Fn fn)
+{
+  for (int i = 0; i < harness.warmup; ++i)
+  {
+    fn();
+  }
+  std::vector<double> samples;
+  CounterSample before = counterSnapshot();
+  for (int i = 0; i < harness.reps; ++i)
+  {
+    Timer timer;
+    fn();
+    samples.push_back(timer.elapsedSec());
+  }
+  CounterSample after = counterSnapshot();
+
+  Stats stats = summarize(samples);
+  stats.counters = counterDelta(before, after, harness.reps);
+  return stats;
+}
+
+// Seconds per call of fn. Calls are batched so one sample spans at least
+// target_ns, which keeps clock overhead out of nanosecond sized operations.
+template <typename Fn>
+Stats perCallStats(const Harness& harness, Fn fn, double target_ns = 10000.0)
+{
+  std::uint64_t batch = 1;
+  for (;;)
+  {
+    Timer timer;
+    for (std::uint64_t i = 0; i < batch; ++i)
+    {
+      fn();
+    }
+    if (timer.elapsedNs() >= target_ns || batch >= (1ULL << 30))
+    {
+      break;
+    }
+    batch *= 2;
+  }
+
+  Stats batched = measure(harness, [&]()
+  {
+    for (std::uint64_t i = 0; i < batch; ++i)
+    {
+      fn();
+    }
+  });
+  std::vector<double> per_call = batched.values;
+  for (std::size_t i = 0; i < per_call.size(); ++i)
+  {
+    per_call[i] /= batch;
+  }
+  Stats stats = summarize(per_call);
+  stats.counters = scaleCounters(batched.counters, batch);
+  return stats;
+}
+
+// one line summary: median time and bandwidth followed by the spread
+std::string formatStats(const Stats& stats, std::uint64_t bytes)
+{
+  std::ostringstream out;
+  out << "median " << stats.median * 1.0e3 << "ms ("
+      << formatRate(bytes, stats.median) << "), min " << stats.min * 1.0e3
+      << "ms, p95 " << stats.p95 * 1.0e3 << "ms, p99 " << stats.p99 * 1.0e3
+      << "ms, stddev " << stats.stddev * 1.0e3 << "ms, " << stats.samples << " reps";
+  if (hasCounters(stats.counters))
+  {
+    out << " | " << formatCounters(stats.counters);
+  }
+  return out.str();
+}
+
+/////////////
+// results
+//
+// Every benchmark records its numbers with recordResult() next to printing
+// them. --json writes all records including the raw samples, and --compare
+// matches them by benchmark and name against such a file from an earlier
+// run, using the samples for confidence intervals.
+
+struct Result
+{
+  std::string benchmark;
+  std::string name;
+  std::string unit;
+  bool lowerIsBetter;
+  // bytes moved per sample, 0 if it doesn't apply
+  std::uint64_t bytes;
+  Stats stats;
+};
+
+std::vector<Result>& results()
+{
+  static std::vector<Result> all;
+  return all;
+}
+
+void recordResult(const std::string& benchmark, const std::string& name,
+                  const Stats& stats, std::uint64_t bytes = 0,
+                  const char* unit = "s", bool lowerIsBetter = true)
+{
+  Result result;
+  result.benchmark = benchmark;
+  result.name = name;
+  result.unit = unit;
+  result.lowerIsBetter = lowerIsBetter;
+  result.bytes = bytes;
+  result.stats = stats;
+  results().push_back(result);
+}
+
+// a single measurement without repetitions, like a one-off allocation
+void recordValue(const std::string& benchmark, const std::string& name, double value,
+                 const char* unit = "s", bool lowerIsBetter = true)
+{
+  recordResult(benchmark, name, summarize(std::vector<double>(1, value)), 0, unit,
+               lowerIsBetter);
+}
+
+/////////////
+// multi-threaded bandwidth
+//
+// The buffer is split into page aligned slices, one per thread. Every thread
+// is pinned to its own cpu and is the first one to touch its slice, so with
+// the default local allocation policy the pages end up on the NUMA node of
+// the cpu that later reads and writes them.
+
+// all threads spin here until the last one arrives, so the timed regions of
+// the workers overlap as much as possible
+class SpinBarrier
+{
+ public:
+  explicit SpinBarrier(int count)
+      : mCount(count),
+        mWaiting(0),
+        mGeneration(0)
+  {
+  }
+
+  void wait()
+  {
+    int generation = mGeneration.load(std::memory_order_acquire);
+    if (mWaiting.fetch_add(1, std::memory_order_acq_rel) + 1 == mCount)
+    {
+      mWaiting.store(0, std::memory_order_relaxed);
+      mGeneration.fetch_add(1, std::memory_order_acq_rel);
+      return;
+    }
+    while (mGeneration.load(std::memory_order_acquire) == generation)
+    {
+      std::this_thread::yield();
+    }
+  }
+
+ private:
+  const int mCount;
+  std::atomic<int> mWaiting;
+  std::atomic<int> mGeneration;
+};
+
+// cpus this process may run on, in ascending order
+std::vector<int> allowedCpus()
+{
+  std::vector<int> cpus;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0)
+  {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+      if (CPU_ISSET(cpu, &set))
+      {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+  if (cpus.empty())
+  {
+    cpus.push_back(0);
+  }
+  return cpus;
+}
+
+bool pinToCpu(int cpu)
+{
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+// NUMA node backing the page at pAddr, or -1 if the kernel won't tell us
+int nodeOfPage(void* pAddr)
+{
+#ifdef SYS_move_pages
+  // move_pages with a NULL node list only queries the page location
+  void* pages[1] = { pAddr };
+  int status[1] = { -1 };
+  if (syscall(SYS_move_pages, 0, 1UL, pages, NULL, status, 0) == 0)
+  {
+    return status[0];
+  }
+#else
+  (void)pAddr;
+#endif
+  return -1;
+}
+
+// anonymous mapping that is not touched yet, so first touch decides placement
+char* mapUntouched(std::uint64_t sizeBytes)
+{
+  void* p = mmap(NULL, sizeBytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return p == MAP_FAILED ? NULL : (char*)p;
+}
+
+enum BandwidthOp
+{
+  OP_MEMSET,
+  OP_MEMCPY,
+  OP_MEMMOVE,
+  OP_COUNT
+};
+
+const char* bandwidthOpName(int op)
+{
+  static const char* names[OP_COUNT] = { "memset", "memcpy", "memmove" };
+  return names[op];
+}
+
+struct LockstepRun
+{
+  // first thread starting to last one finishing, per timed repetition
+  Stats aggregate;
+  std::vector<Stats> perThread;
+};
+
+// Runs body(t) on num_threads pinned threads in lockstep, warmup + reps
+// times, each repetition released by a barrier. Thread t always lands on
+// the same cpu, so data it touched first stays node local. Counters cover
+// the warmups too and are divided over all repetitions.
+template <typename Body>
+LockstepRun runLockstep(const std::vector<int>& cpus, int num_threads,
+                        const Harness& harness, Body body)
+{
+  std::vector<std::uint64_t> starts(num_threads * harness.reps);
+  std::vector<std::uint64_t> stops(num_threads * harness.reps);
+  SpinBarrier barrier(num_threads);
+  std::vector<std::thread> threads;
+
+  CounterSample before = counterSnapshot();
+  for (int t = 0; t < num_threads; ++t)
+  {
+    threads.push_back(std::thread([&, t]()
+    {
+      pinToCpu(cpus[t % cpus.size()]);
+      for (int rep = 0; rep < harness.warmup + harness.reps; ++rep)
+      {
+        barrier.wait();
+        std::uint64_t start = nowNs();
+        body(t);
+        std::uint64_t stop = nowNs();
+        if (rep >= harness.warmup)
+        {
+          starts[t * harness.reps + rep - harness.warmup] = start;
+          stops[t * harness.reps + rep - harness.warmup] = stop;
+        }
+      }
+    }));
+  }
+  for (std::size_t t = 0; t < threads.size(); ++t)
+  {
+    threads[t].join();
+  }
+  CounterSample after = counterSnapshot();
+
+  LockstepRun run;
+  std::vector<double> aggregate;
+  for (int rep = 0; rep < harness.reps; ++rep)
+  {
+    std::uint64_t first = starts[rep];
+    std::uint64_t last = stops[rep];
+    for (int t = 1; t < num_threads; ++t)
+    {
+      first = std::min(first, starts[t * harness.reps + rep]);
+      last = std::max(last, stops[t * harness.reps + rep]);
+    }
+    aggregate.push_back((last - first) / 1.0e9);
+  }
+  run.aggregate = summarize(aggregate);
+  run.aggregate.counters = counterDelta(before, after, harness.warmup + harness.reps);
+
+  for (int t = 0; t < num_threads; ++t)
+  {
+    std::vector<double> seconds;
+    for (int rep = 0; rep < harness.reps; ++rep)
+    {
+      seconds.push_back((stops[t * harness.reps + rep] - starts[t * harness.reps + rep]) / 1.0e9);
+    }
+    run.perThread.push_back(summarize(seconds));
+  }
+  return run;
+}
+
+struct ThreadResult
+{
+  int cpu;
+  int node;
+  Stats stats[OP_COUNT];
+};
+
+struct ThreadedRun
+{
+  std::vector<ThreadResult> results;
+  Stats aggregate[OP_COUNT];
+};
+
+// run every op on num_threads pinned threads, each on its own slice of
+// slice_bytes; returns false if the buffers could not be mapped
+bool runThreadedOps(const std::vector<int>& cpus, int num_threads,
+                    std::uint64_t slice_bytes, const Harness& harness,
+                    ThreadedRun& run)
+{
+  const std::uint64_t total_bytes = slice_bytes * num_threads;
+  char* p_src = mapUntouched(total_bytes);
+  char* p_dest = mapUntouched(total_bytes);
+  if (p_src == NULL || p_dest == NULL)
+  {
+    std::cerr << "ERROR: mmap of 2x " << formatBytes(total_bytes)
+              << " for threaded test failed!" << std::endl;
+    if (p_src != NULL) munmap(p_src, total_bytes);
+    if (p_dest != NULL) munmap(p_dest, total_bytes);
+    return false;
+  }
+
+  // first touch from the pinned thread places the pages locally
+  run.results.assign(num_threads, ThreadResult());
+  Harness once;
+  once.warmup = 0;
+  once.reps = 1;
+  runLockstep(cpus, num_threads, once, [&](int t)
+  {
+    ThreadResult& result = run.results[t];
+    result.cpu = cpus[t % cpus.size()];
+    memset(p_src + t * slice_bytes, 0xF, slice_bytes);
+    memset(p_dest + t * slice_bytes, 0xF, slice_bytes);
+    result.node = nodeOfPage(p_src + t * slice_bytes);
+  });
+
+  for (int op = 0; op < OP_COUNT; ++op)
+  {
+    LockstepRun lockstep = runLockstep(cpus, num_threads, harness, [&](int t)
+    {
+      char* p_my_src = p_src + t * slice_bytes;
+      char* p_my_dest = p_dest + t * slice_bytes;
+      switch (op)
+      {
+        case OP_MEMSET:
+          memset(p_my_dest, 0xA, slice_bytes);
+          break;
+        case OP_MEMCPY:
+          memcpy(p_my_dest, p_my_src, slice_bytes);
+          break;
+        case OP_MEMMOVE:
+          doMemmove(p_my_dest, p_my_src, slice_bytes);
+          break;
+      }
+    });
+    run.aggregate[op] = lockstep.aggregate;
+    for (int t = 0; t < num_threads; ++t)
+    {
+      run.results[t].stats[op] = lockstep.perThread[t];
+    }
+  }
+
+  munmap(p_src, total_bytes);
+  munmap(p_dest, total_bytes);
+  return true;
+}
+
+int runThreadedBandwidth(std::uint64_t size_bytes, int num_threads,
+                         const Harness& harness)
+{
+  std::vector<int> cpus = allowedCpus();
+  if (num_threads <= 0)
+  {
+    num_threads = (int)cpus.size();
+  }
+  if (num_threads > (int)cpus.size())
+  {
+    std::cout << "NOTE: " << num_threads << " threads but only " << cpus.size()
+              << " cpus available, some cpus will be shared" << std::endl;
+  }
+
+  // page aligned slices so no page is shared between two threads
+  const std::uint64_t page = sysconf(_SC_PAGESIZE);
+  std::uint64_t slice_bytes = size_bytes / num_threads;
+  slice_bytes -= slice_bytes % page;
+  if (slice_bytes == 0)
+  {
+    std::cerr << "ERROR: " << formatBytes(size_bytes) << " is too small to split"
+              << " across " << num_threads << " threads" << std::endl;
+    return 1;
+  }
+
+  std::cout << "Threaded bandwidth: " << num_threads << " threads x "
+            << formatBytes(slice_bytes) << " = "
+            << formatBytes(slice_bytes * num_threads) << std::endl;
+
+  // baseline is a single pinned thread working on one slice of the same size
+  ThreadedRun baseline;
+  if (!runThreadedOps(cpus, 1, slice_bytes, harness, baseline))
+  {
+    return 1;
+  }
+
+  ThreadedRun run;
+  if (!runThreadedOps(cpus, num_threads, slice_bytes, harness, run))
+  {
+    return 1;
+  }
+
+  for (int op = 0; op < OP_COUNT; ++op)
+  {
+    std::cout << std::endl << bandwidthOpName(op) << ":" << std::endl;
+    for (int t = 0; t < num_threads; ++t)
+    {
+      const ThreadResult& result = run.results[t];
+      std::cout << "  thread " << t << " (cpu " << result.cpu << ", node "
+                << result.node << ") " << formatStats(result.stats[op], slice_bytes)
+                << std::endl;
+      recordResult("threads", std::string(bandwidthOpName(op)) + "/thread" +
+                   std::to_string(t), result.stats[op], slice_bytes);
+    }
+
+    // efficiency compares medians
+    const Stats& single = baseline.results[0].stats[op];
+    double single_bw = slice_bytes / single.median;
+    double aggregate_bw = (slice_bytes * num_threads) / run.aggregate[op].median;
+    std::cout << "  single thread baseline: " << formatStats(single, slice_bytes)
+              << std::endl
+              << "  aggregate: "
+              << formatStats(run.aggregate[op], slice_bytes * num_threads)
+              << std::endl
+              << "  scaling efficiency: "
+              << 100.0 * aggregate_bw / (single_bw * num_threads) << "%"
+              << std::endl;
+
+    const std::string name = bandwidthOpName(op);
+    recordResult("threads", name + "/baseline", single, slice_bytes);
+    recordResult("threads", name + "/aggregate", run.aggregate[op],
+                 slice_bytes * num_threads);
+    recordValue("threads", name + "/efficiency",
+                100.0 * aggregate_bw / (single_bw * num_threads), "%", false);
+  }
+
+  return 0;
+}
+
+/////////////
+// copy kernels
+//
+// Every kernel registers itself with REGISTER_COPY_KERNEL, and --kernels times
+// all of the ones the cpu supports on the same pair of buffers. The SIMD
+// kernels are compiled with per-function target attributes, so the binary
+// still runs on any x86-64 and picks them at runtime.
+
+typedef void (*CopyFn)(void* pDest, const void* pSource, std::size_t sizeBytes);
+typedef void (*FillFn)(void* pDest, int value, std::size_t sizeBytes);
+
+struct CopyKernel
+{
+  const char* name;
+  CopyFn copy;
+  FillFn fill;
+  bool (*supported)();
+};
+
+std::vector<CopyKernel>& copyKernels()
+{
+  static std::vector<CopyKernel> kernels;
+  return kernels;
+}
+
+struct CopyKernelRegistrar
+{
+  CopyKernelRegistrar(const char* name, CopyFn copy, FillFn fill, bool (*supported)())
+  {
+    CopyKernel kernel = { name, copy, fill, supported };
+    copyKernels().push_back(kernel);
+  }
+};
+
+#define REGISTER_COPY_KERNEL(id, name, copy, fill, supported) \
+  static CopyKernelRegistrar s_copy_kernel_##id(name, copy, fill, supported)
+
+// keep gcc from turning the byte loops back into memcpy/memset calls or
+// vectorizing them
+#if defined(__GNUC__) && !defined(__clang__)
+#define MEMTEST_NO_VECTORIZE \
+  __attribute__((optimize("no-tree-vectorize", "no-tree-loop-distribute-patterns")))
+#else
+#define MEMTEST_NO_VECTORIZE
+#endif
+
+bool alwaysSupported()
+{
+  return true;
+}
+
+void libcCopy(void* pDest, const void* pSource, std::size_t sizeBytes)
+{
+  memcpy(pDest, pSource, sizeBytes);
+}
+
+void libcFill(void* pDest, int value, std::size_t sizeBytes)
+{
+  memset(pDest, value, sizeBytes);
+}
+
+REGISTER_COPY_KERNEL(libc, "libc", libcCopy, libcFill, alwaysSupported);
+
+MEMTEST_NO_VECTORIZE
+void byteCopy(void* pDest, const void* pSource, std::size_t sizeBytes)
+{
+  char* p_dest = (char*)pDest;
+  const char* p_src = (const char*)pSource;
+  for (std::size_t i = 0; i < sizeBytes; ++i)
+  {
+    p_dest[i] = p_src[i];
+  }
+}
+
+MEMTEST_NO_VECTORIZE
+void byteFill(void* pDest, int value, std::size_t sizeBytes)
+{
+  char* p_dest = (char*)pDest;
+  for (std::size_t i = 0; i < sizeBytes; ++i)
+  {
+    p_dest[i] = (char)value;
+  }
+}
+
+REGISTER_COPY_KERNEL(byte, "byte-loop", byteCopy, byteFill, alwaysSupported);
+
+#ifdef MEMTEST_X86
+
+// bytes needed to bring p up to the next multiple of align, capped at sizeBytes
+inline std::size_t headBytes(const void* p, std::size_t align, std::size_t sizeBytes)
+{
+  std::size_t head = (align - ((std::uintptr_t)p & (align - 1))) & (align - 1);
+  return head < sizeBytes ? head : sizeBytes;
+}
+
+bool hasAvx2()
+{
+  return __builtin_cpu_supports("avx2");
+}
+
+bool hasAvx512()
+{
+  return __builtin_cpu_supports("avx512f");
+}
+
+// sse2 is part of the x86-64 baseline; loads are unaligned, stores are
+// aligned after copying the head byte-wise
+void sse2Copy(void* pDest, const void* pSource, std::size_t sizeBytes)
+{
+  char* p_dest = (char*)pDest;
+  const char* p_src = (const char*)pSource;
+  std::size_t head = headBytes(p_dest, 16, sizeBytes);
+  byteCopy(p_dest, p_src, head);
+  p_dest += head;
+  p_src += head;
+  sizeBytes -= head;
+
+  for (; sizeBytes >= 64; sizeBytes -= 64, p_dest += 64, p_src += 64)
+  {
+    __m128i a = _mm_loadu_si128((const __m128i*)(p_src + 0));
+    __m128i b = _mm_loadu_si128((const __m128i*)(p_src + 16));
+    __m128i c = _mm_loadu_si128((const __m128i*)(p_src + 32));
+    __m128i d = _mm_loadu_si128((const __m128i*)(p_src + 48));
+    _mm_store_si128((__m128i*)(p_dest + 0), a);
+    _mm_store_si128((__m128i*)(p_dest + 16), b);
+    _mm_store_si128((__m128i*)(p_dest + 32), c);
+    _mm_store_si128((__m128i*)(p_dest + 48), d);
+  }
+  for (; sizeBytes >= 16; sizeBytes -= 16, p_dest += 16, p_src += 16)
+  {
+    _mm_store_si128((__m128i*)p_dest, _mm_loadu_si128((const __m128i*)p_src));
+  }
+  byteCopy(p_dest, p_src, sizeBytes);
+}
+
+void sse2Fill(void* pDest, int value, std::size_t sizeBytes)
+{
+  char* p_dest = (char*)pDest;
+  std::size_t head = headBytes(p_dest, 16, sizeBytes);
+  byteFill(p_dest, value, head);
+  p_dest += head;
+  sizeBytes -= head;
+
+  const __m128i v = _mm_set1_epi8((char)value);
+  for (; sizeBytes >= 64; sizeBytes -= 64, p_dest += 64)
+  {
+    _mm_store_si128((__m128i*)(p_dest + 0), v);
+    _mm_store_si128((__m128i*)(p_dest + 16), v);
+    _mm_store_si128((__m128i*)(p_dest + 32), v);
+    _mm_store_si128((__m128i*)(p_dest + 48), v);
+  }
+  for (; sizeBytes >= 16; sizeBytes -= 16, p_dest += 16)
+  {
+    _mm_store_si128((__m128i*)p_dest, v);
+  }
+  byteFill(p_dest, value, sizeBytes);
+}
+
+REGISTER_COPY_KERNEL(sse2, "sse2", sse2Copy, sse2Fill, alwaysSupported);
+
+__attribute__((target("avx2")))
+void avx2Copy(void* pDest, const void* pSource, std::size_t sizeBytes)
+{
+  char* p_dest = (char*)pDest;
+  const char* p_src = (const char*)pSource;
+  std::size_t head = headBytes(p_dest, 32, sizeBytes);
+  byteCopy(p_dest, p_src, head);
+  p_dest += head;
+  p_src += head;
+  sizeBytes -= head;
+
+  for (; sizeBytes >= 128; sizeBytes -= 128, p_dest += 128, p_src += 128)
+  {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(p_src + 0));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(p_src + 32));
+    __m256i c = _mm256_loadu_si256((const __m256i*)(p_src + 64));
+    __m256i d = _mm256_loadu_si256((const __m256i*)(p_src + 96));
+    _mm256_store_si256((__m256i*)(p_dest + 0), a);
+    _mm256_store_si256((__m256i*)(p_dest + 32), b);
+    _mm256_store_si256((__m256i*)(p_dest + 64), c);
+    _mm256_store_si256((__m256i*)(p_dest + 96), d);
+  }
+  for (; sizeBytes >= 32; sizeBytes -= 32, p_dest += 32, p_src += 32)
+  {
+    _mm256_store_si256((__m256i*)p_dest, _mm256_loadu_si256((const __m256i*)p_src));
+  }
+  byteCopy(p_dest, p_src, sizeBytes);
+}
+
+__attribute__((target("avx2")))
+void avx2Fill(void* pDest, int value, std::size_t sizeBytes)
+{
+  char* p_dest = (char*)pDest;
+  std::size_t head = headBytes(p_dest, 32, sizeBytes);
+  byteFill(p_dest, value, head);
+  p_dest += head;
+  sizeBytes -= head;
+
+  const __m256i v = _mm256_set1_epi8((char)value);
+  for (; sizeBytes >= 128; sizeBytes -= 128, p_dest += 128)
+  {
+    _mm256_store_si256((__m256i*)(p_dest + 0), v);
+    _mm256_store_si256((__m256i*)(p_dest + 32), v);
+    _mm256_store_si256((__m256i*)(p_dest + 64), v);
+    _mm256_store_si256((__m256i*)(p_dest + 96), v);
+  }
+  for (; sizeBytes >= 32; sizeBytes -= 32, p_dest += 32)
+  {
+    _mm256_store_si256((__m256i*)p_dest, v);
+  }
+  byteFill(p_dest, value, sizeBytes);
+}
+
+REGISTER_COPY_KERNEL(avx2, "avx2", avx2Copy, avx2Fill, hasAvx2);
+
+__attribute__((target("avx512f")))
+void avx512Copy(void* pDest, const void* pSource, std::size_t sizeBytes)
+{
+  char* p_dest = (char*)pDest;
+  const char* p_src = (const char*)pSource;
+  std::size_t head = headBytes(p_dest, 64, sizeBytes);
+  byteCopy(p_dest, p_src, head);
+  p_dest += head;
+  p_src += head;
+  sizeBytes -= head;
+
+  for (; sizeBytes >= 256; sizeBytes -= 256, p_dest += 256, p_src += 256)
+  {
+    __m512i a = _mm512_loadu_si512((const void*)(p_src + 0));
+    __m512i b = _mm512_loadu_si512((const void*)(p_src + 64));
+    __m512i c = _mm512_loadu_si512((const void*)(p_src + 128));
+    __m512i d = _mm512_loadu_si512((const void*)(p_src + 192));
+    _mm512_store_si512((void*)(p_dest + 0), a);
+    _mm512_store_si512((void*)(p_dest + 64), b);
+    _mm512_store_si512((void*)(p_dest + 128), c);
+    _mm512_store_si512((void*)(p_dest + 192), d);
+  }
+  for (; sizeBytes >= 64; sizeBytes -= 64, p_dest += 64, p_src += 64)
+  {
+    _mm512_store_si512((void*)p_dest, _mm512_loadu_si512((const void*)p_src));
+  }
+  byteCopy(p_dest, p_src, sizeBytes);
+}
+
+__attribute__((target("avx512f")))
+void avx512Fill(void* pDest, int value, std::size_t sizeBytes)
+{
+  char* p_dest = (char*)pDest;
+  std::size_t head = headBytes(p_dest, 64, sizeBytes);
+  byteFill(p_dest, value, head);
+  p_dest += head;
+  sizeBytes -= head;
+
+  const __m512i v = _mm512_set1_epi32(0x01010101 * (value & 0xFF));
+  for (; sizeBytes >= 256; sizeBytes -= 256, p_dest += 256)
+  {
+    _mm512_store_si512((void*)(p_dest + 0), v);
+    _mm512_store_si512((void*)(p_dest + 64), v);
+    _mm512_store_si512((void*)(p_dest + 128), v);
+    _mm512_store_si512((void*)(p_dest + 192), v);
+  }
+  for (; sizeBytes >= 64; sizeBytes -= 64, p_dest += 64)
+  {
+    _mm512_store_si512((void*)p_dest, v);
+  }
+  byteFill(p_dest, value, sizeBytes);
+}
+
+REGISTER_COPY_KERNEL(avx512, "avx512", avx512Copy, avx512Fill, hasAvx512);
+
+// "enhanced rep movsb" cpus (erms) make the string instructions competitive
+// with vector loops for large sizes
+void repMovsbCopy(void* pDest, const void* pSource, std::size_t sizeBytes)
+{
+  asm volatile("rep movsb"
+               : "+D"(pDest), "+S"(pSource), "+c"(sizeBytes)
+               :
+               : "memory");
+}
+
+void repStosbFill(void* pDest, int value, std::size_t sizeBytes)
+{
+  asm volatile("rep stosb"
+               : "+D"(pDest), "+c"(sizeBytes)
+               : "a"(value)
+               : "memory");
+}
+
+REGISTER_COPY_KERNEL(rep, "rep-movsb", repMovsbCopy, repStosbFill, alwaysSupported);
+
+// non-temporal stores bypass the cache hierarchy, which only pays off once
+// the destination is much larger than the last level cache
+void ntSse2Copy(void* pDest, const void* pSource, std::size_t sizeBytes)
+{
+  char* p_dest = (char*)pDest;
+  const char* p_src = (const char*)pSource;
+  std::size_t head = headBytes(p_dest, 16, sizeBytes);
+  byteCopy(p_dest, p_src, head);
+  p_dest += head;
+  p_src += head;
+  sizeBytes -= head;
+
+  for (; sizeBytes >= 64; sizeBytes -= 64, p_dest += 64, p_src += 64)
+  {
+    __m128i a = _mm_loadu_si128((const __m128i*)(p_src + 0));
+    __m128i b = _mm_loadu_si128((const __m128i*)(p_src + 16));
+    __m128i c = _mm_loadu_si128((const __m128i*)(p_src + 32));
+    __m128i d = _mm_loadu_si128((const __m128i*)(p_src + 48));
+    _mm_stream_si128((__m128i*)(p_dest + 0), a);
+    _mm_stream_si128((__m128i*)(p_dest + 16), b);
+    _mm_stream_si128((__m128i*)(p_dest + 32), c);
+    _mm_stream_si128((__m128i*)(p_dest + 48), d);
+  }
+  for (; sizeBytes >= 16; sizeBytes -= 16, p_dest += 16, p_src += 16)
+  {
+    _mm_stream_si128((__m128i*)p_dest, _mm_loadu_si128((const __m128i*)p_src));
+  }
+  _mm_sfence();
+  byteCopy(p_dest, p_src, sizeBytes);
+}
+
+void ntSse2Fill(void* pDest, int value, std::size_t sizeBytes)
+{
+  char* p_dest = (char*)pDest;
+  std::size_t head = headBytes(p_dest, 16, sizeBytes);
+  byteFill(p_dest, value, head);
+  p_dest += head;
+  sizeBytes -= head;
+
+  const __m128i v = _mm_set1_epi8((char)value);
+  for (; sizeBytes >= 64; sizeBytes -= 64, p_dest += 64)
+  {
+    _mm_stream_si128((__m128i*)(p_dest + 0), v);
+    _mm_stream_si128((__m128i*)(p_dest + 16), v);
+    _mm_stream_si128((__m128i*)(p_dest + 32), v);
+    _mm_stream_si128((__m128i*)(p_dest + 48), v);
+  }
+  for (; sizeBytes >= 16; sizeBytes -= 16, p_dest += 16)
+  {
+    _mm_stream_si128((__m128i*)p_dest, v);
+  }
+  _mm_sfence();
+  byteFill(p_dest, value, sizeBytes);
+}
+
+REGISTER_COPY_KERNEL(nt_sse2, "nt-sse2", ntSse2Copy, ntSse2Fill, alwaysSupported);
+
+__attribute__((target("avx2")))
+void ntAvx2Copy(void* pDest, const void* pSource, std::size_t sizeBytes)
+{
+  char* p_dest = (char*)pDest;
+  const char* p_src = (const char*)pSource;
+  std::size_t head = headBytes(p_dest, 32, sizeBytes);
+  byteCopy(p_dest, p_src, head);
+  p_dest += head;
+  p_src += head;
+  sizeBytes -= head;
+
+  for (; sizeBytes >= 128; sizeBytes -= 128, p_dest += 128, p_src += 128)
+  {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(p_src + 0));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(p_src + 32));
+    __m256i c = _mm256_loadu_si256((const __m256i*)(p_src + 64));
+    __m256i d = _mm256_loadu_si256((const __m256i*)(p_src + 96));
+    _mm256_stream_si256((__m256i*)(p_dest + 0), a);
+    _mm256_stream_si256((__m256i*)(p_dest + 32), b);
+    _mm256_stream_si256((__m256i*)(p_dest + 64), c);
+    _mm256_stream_si256((__m256i*)(p_dest + 96), d);
+  }
+  for (; sizeBytes >= 32; sizeBytes -= 32, p_dest += 32, p_src += 32)
+  {
+    _mm256_stream_si256((__m256i*)p_dest, _mm256_loadu_si256((const __m256i*)p_src));
+  }
+  _mm_sfence();
+  byteCopy(p_dest, p_src, sizeBytes);
+}
+
+__attribute__((target("avx2")))
+void ntAvx2Fill(void* pDest, int value, std::size_t sizeBytes)
+{
+  char* p_dest = (char*)pDest;
+  std::size_t head = headBytes(p_dest, 32, sizeBytes);
+  byteFill(p_dest, value, head);
+  p_dest += head;
+  sizeBytes -= head;
+
+  const __m256i v = _mm256_set1_epi8((char)value);
+  for (; sizeBytes >= 128; sizeBytes -= 128, p_dest += 128)
+  {
+    _mm256_stream_si256((__m256i*)(p_dest + 0), v);
+    _mm256_stream_si256((__m256i*)(p_dest + 32), v);
+    _mm256_stream_si256((__m256i*)(p_dest + 64), v);
+    _mm256_stream_si256((__m256i*)(p_dest + 96), v);
+  }
+  for (; sizeBytes >= 32; sizeBytes -= 32, p_dest += 32)
+  {
+    _mm256_stream_si256((__m256i*)p_dest, v);
+  }
+  _mm_sfence();
+  byteFill(p_dest, value, sizeBytes);
+}
+
+REGISTER_COPY_KERNEL(nt_avx2, "nt-avx2", ntAvx2Copy, ntAvx2Fill, hasAvx2);
+
+#endif // MEMTEST_X86
+
+int runCopyKernels(std::uint64_t size_bytes, const Harness& harness)
+{
+  char* p_src = (char*)malloc(size_bytes);
+  char* p_dest = (char*)malloc(size_bytes);
+  if (p_src == NULL || p_dest == NULL)
+  {
+    std::cerr << "ERROR: malloc of 2x " << formatBytes(size_bytes)
+              << " for kernel test returned NULL!" << std::endl;
+    free(p_src);
+    free(p_dest);
+    return 1;
+  }
+
+  // fault everything in up front so no kernel pays for the first touch
+  for (std::uint64_t i = 0; i < size_bytes; ++i)
+  {
+    p_src[i] = (char)(i * 131);
+  }
+  memset(p_dest, 0, size_bytes);
+
+  std::cout << "Copy kernels on " << formatBytes(size_bytes) << ":" << std::endl;
+  const std::vector<CopyKernel>& kernels = copyKernels();
+  for (std::size_t k = 0; k < kernels.size(); ++k)
+  {
+    const CopyKernel& kernel = kernels[k];
+    std::cout << "  " << kernel.name << ":";
+    if (!kernel.supported())
+    {
+      std::cout << " skipped (not supported by this cpu)" << std::endl;
+      continue;
+    }
+
+    Stats fill = measure(harness, [&]() { kernel.fill(p_dest, 0xA, size_bytes); });
+    Stats copy = measure(harness, [&]() { kernel.copy(p_dest, p_src, size_bytes); });
+
+    if (memcmp(p_dest, p_src, size_bytes) != 0)
+    {
+      std::cout << " MISMATCH, kernel is broken";
+    }
+    std::cout << std::endl
+              << "    fill " << formatStats(fill, size_bytes) << std::endl
+              << "    copy " << formatStats(copy, size_bytes) << std::endl;
+    recordResult("kernels", std::string(kernel.name) + "/fill", fill, size_bytes);
+    recordResult("kernels", std::string(kernel.name) + "/copy", copy, size_bytes);
+  }
+
+  free(p_src);
+  free(p_dest);
+  return 0;
+}
+
+/////////////
+// size sweep
+//
+// Runs memset/memcpy/memmove at geometrically spaced sizes and prints one CSV
+// row per (op, size). The knees in the bandwidth column line up with the
+// cache sizes listed in the header comments.
+
+double runBandwidthOp(int op, char* p_dest, const char* p_src,
+                      std::uint64_t size_bytes, std::uint64_t iterations)
+{
+  Timer timer;
+  for (std::uint64_t i = 0; i < iterations; ++i)
+  {
+    switch (op)
+    {
+      case OP_MEMSET:
+        memset(p_dest, 0xA, size_bytes);
+        break;
+      case OP_MEMCPY:
+        memcpy(p_dest, p_src, size_bytes);
+        break;
+      case OP_MEMMOVE:
+        doMemmove(p_dest, p_src, size_bytes);
+        break;
+    }
+    clobberMemory(p_dest);
+  }
+  return timer.elapsedSec();
+}
+
+struct SweepPoint
+{
+  bool stable;
+  // bandwidth samples in bytes/s
+  Stats stats;
+  double cv;
+};
+
+// take bandwidth samples until the 95% confidence interval of the mean is
+// within 1% of it, or the time budget for this size runs out
+SweepPoint measureSweepPoint(int op, char* p_dest, const char* p_src,
+                             std::uint64_t size_bytes)
+{
+  static const int min_samples = 5;
+  static const int max_samples = 50;
+  static const double min_sample_seconds = 1.0e-3;
+  static const double budget_seconds = 2.0;
+  static const double target_ci = 0.01;
+
+  // calibrate how many back to back calls make one sample long enough to
+  // swamp the clock overhead
+  double once = runBandwidthOp(op, p_dest, p_src, size_bytes, 1);
+  std::uint64_t iterations = 1;
+  if (once < min_sample_seconds)
+  {
+    iterations = (std::uint64_t)(min_sample_seconds / std::max(once, 1.0e-9)) + 1;
+  }
+
+  std::vector<double> bandwidths;
+  double spent = 0.0;
+  Stats stats = Stats();
+  SweepPoint point;
+  point.stable = false;
+  CounterSample before = counterSnapshot();
+  while ((int)bandwidths.size() < max_samples)
+  {
+    double seconds = runBandwidthOp(op, p_dest, p_src, size_bytes, iterations);
+    spent += seconds;
+    bandwidths.push_back(size_bytes * (double)iterations / seconds);
+
+    stats = summarize(bandwidths);
+    if (stats.samples >= min_samples)
+    {
+      if (1.96 * stats.stddev / std::sqrt((double)stats.samples) <= target_ci * stats.mean)
+      {
+        point.stable = true;
+        break;
+      }
+      if (spent > budget_seconds)
+      {
+        break;
+      }
+    }
+  }
+
+  point.stats = stats;
+  point.stats.counters = counterDelta(before, counterSnapshot(),
+                                      (double)iterations * bandwidths.size());
+  point.cv = stats.mean > 0.0 ? stats.stddev / stats.mean : 0.0;
+  return point;
+}
+
+void printCacheSizes(std::ostream& out)
+{
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+  struct { const char* name; int conf; } levels[] = {
+    { "L1d", _SC_LEVEL1_DCACHE_SIZE },
+    { "L2", _SC_LEVEL2_CACHE_SIZE },
+    { "L3", _SC_LEVEL3_CACHE_SIZE },
+    { "L4", _SC_LEVEL4_CACHE_SIZE },
+  };
+  for (std::size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); ++i)
+  {
+    long size = sysconf(levels[i].conf);
+    if (size > 0)
+    {
+      out << "# " << levels[i].name << " cache: " << formatBytes(size) << std::endl;
+    }
+  }
+#else
+  (void)out;
+#endif
+}
+
+int runSizeSweep(std::uint64_t max_bytes, int steps_per_octave)
+{
+  static const std::uint64_t min_bytes = 4096;
+  if (steps_per_octave < 1)
+  {
+    steps_per_octave = 1;
+  }
+
+  // fall back to smaller maxima when the host can't give us two buffers
+  char* p_src = NULL;
+  char* p_dest = NULL;
+  while (max_bytes >= min_bytes)
+  {
+    p_src = (char*)malloc(max_bytes);
+    p_dest = (char*)malloc(max_bytes);
+    if (p_src != NULL && p_dest != NULL)
+    {
+      break;
+    }
+    free(p_src);
+    free(p_dest);
+    p_src = p_dest = NULL;
+    std::cerr << "NOTE: could not allocate 2x " << formatBytes(max_bytes)
+              << ", halving the sweep maximum" << std::endl;
+    max_bytes /= 2;
+  }
+  if (p_src == NULL)
+  {
+    std::cerr << "ERROR: could not allocate sweep buffers" << std::endl;
+    return 1;
+  }
+  memset(p_src, 0xF, max_bytes);
+  memset(p_dest, 0xF, max_bytes);
+
+  // geometric steps, rounded to cache lines and deduplicated
+  std::vector<std::uint64_t> sizes;
+  const double ratio = std::pow(2.0, 1.0 / steps_per_octave);
+  for (double size = min_bytes; size <= (double)max_bytes; size *= ratio)
+  {
+    std::uint64_t rounded = ((std::uint64_t)size + 63) & ~(std::uint64_t)63;
+    if (rounded <= max_bytes && (sizes.empty() || rounded != sizes.back()))
+    {
+      sizes.push_back(rounded);
+    }
+  }
+
+  std::cout << "# size sweep " << formatBytes(min_bytes) << " .. "
+            << formatBytes(max_bytes) << ", " << steps_per_octave
+            << " steps per octave" << std::endl;
+  printCacheSizes(std::cout);
+  std::cout << "op,size_bytes,samples,stable,median_gbps,min_gbps,max_gbps,cv"
+            << counterCsvHeader() << std::endl;
+
+  for (int op = 0; op < OP_COUNT; ++op)
+  {
+    for (std::size_t i = 0; i < sizes.size(); ++i)
+    {
+      SweepPoint point = measureSweepPoint(op, p_dest, p_src, sizes[i]);
+      std::cout << bandwidthOpName(op) << "," << sizes[i] << ","
+                << point.stats.samples << "," << (point.stable ? 1 : 0) << ","
+                << point.stats.median / 1.0e9 << "," << point.stats.min / 1.0e9 << ","
+                << point.stats.max / 1.0e9 << "," << point.cv
+                << counterCsvFields(point.stats.counters) << std::endl;
+      recordResult("sweep", std::string(bandwidthOpName(op)) + "/" +
+                   std::to_string(sizes[i]), point.stats, sizes[i], "B/s", false);
+    }
+  }
+
+  free(p_src);
+  free(p_dest);
+  return 0;
+}
+
+/////////////
+// pointer chasing latency
+//
+// Every load depends on the previous one, so the time per step is the full
+// load-to-use latency at the given working set size. The ring visits the
+// cells in a random order (Sattolo's algorithm gives a single cycle) which
+// defeats the hardware prefetchers.
+
+static const std::uint64_t HUGE_PAGE_BYTES = 2 * 1024 * 1024;
+
+// try explicit hugetlbfs pages first, then transparent huge pages; describes
+// what it got in how
+char* mapHugeBuffer(std::uint64_t sizeBytes, std::string& how)
+{
+#ifdef MAP_HUGETLB
+  void* p = mmap(NULL, sizeBytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (p != MAP_FAILED)
+  {
+    how = "hugetlbfs";
+    return (char*)p;
+  }
+#endif
+  char* p_buf = mapUntouched(sizeBytes);
+  if (p_buf == NULL)
+  {
+    return NULL;
+  }
+#ifdef MADV_HUGEPAGE
+  if (madvise(p_buf, sizeBytes, MADV_HUGEPAGE) == 0)
+  {
+    how = "transparent huge pages";
+    return p_buf;
+  }
+#endif
+  how = "4KB pages (huge pages unavailable)";
+  return p_buf;
+}
+
+// link cells of stride bytes in the first working_set bytes of p_buf into one
+// random cycle and return the start of it; a non-zero skew moves cell i by
+// i * skew within its stride, so cells one page apart don't share a cache set
+void** buildChaseRing(char* p_buf, std::uint64_t working_set, std::uint64_t stride,
+                      std::mt19937_64& rng, std::uint64_t skew = 0)
+{
+  const std::uint64_t cells = working_set / stride;
+  std::vector<std::uint64_t> order(cells);
+  for (std::uint64_t i = 0; i < cells; ++i)
+  {
+    order[i] = i;
+  }
+  // Sattolo: like Fisher-Yates but j < i, which yields one cycle through all
+  for (std::uint64_t i = cells - 1; i > 0; --i)
+  {
+    std::uniform_int_distribution<std::uint64_t> pick(0, i - 1);
+    std::swap(order[i], order[pick(rng)]);
+  }
+  for (std::uint64_t i = 0; i < cells; ++i)
+  {
+    order[i] = order[i] * stride + order[i] * skew % stride;
+  }
+  for (std::uint64_t i = 0; i < cells; ++i)
+  {
+    void** p_cell = (void**)(p_buf + order[i]);
+    *p_cell = p_buf + order[(i + 1) % cells];
+  }
+  return (void**)(p_buf + order[0]);
+}
+
+// follow the ring for loads steps, unrolled so the loop overhead hides in
+// the load latency
+void** chase(void** p, std::uint64_t loads)
+{
+  for (std::uint64_t i = 0; i < loads; i += 8)
+  {
+    p = (void**)*p; p = (void**)*p; p = (void**)*p; p = (void**)*p;
+    p = (void**)*p; p = (void**)*p; p = (void**)*p; p = (void**)*p;
+  }
+  return p;
+}
+
+// seconds per load, with every sample chasing long enough to take 20ms
+Stats measureChase(void** p_start, std::uint64_t cells, const Harness& harness)
+{
+  static const double min_sample_seconds = 0.02;
+
+  // one warm lap pulls the ring into whatever level of the hierarchy it fits
+  void** p = chase(p_start, std::max<std::uint64_t>(cells, 8));
+
+  std::uint64_t loads = std::max<std::uint64_t>(cells, 1 << 16);
+  loads = (loads + 7) & ~(std::uint64_t)7;
+  for (;;)
+  {
+    Timer timer;
+    p = chase(p, loads);
+    double seconds = timer.elapsedSec();
+    clobberMemory(p);
+    if (seconds >= min_sample_seconds)
+    {
+      break;
+    }
+    loads *= 2;
+  }
+
+  Stats stats = measure(harness, [&]()
+  {
+    p = chase(p, loads);
+    clobberMemory(p);
+  });
+  std::vector<double> per_load = stats.values;
+  for (std::size_t i = 0; i < per_load.size(); ++i)
+  {
+    per_load[i] /= loads;
+  }
+  Stats result = summarize(per_load);
+  result.counters = scaleCounters(stats.counters, loads);
+  return result;
+}
+
+int runLatency(std::uint64_t max_bytes, std::uint64_t stride, bool huge_pages,
+               int steps_per_octave, const Harness& harness)
+{
+  if (stride < sizeof(void*) || stride % sizeof(void*) != 0)
+  {
+    std::cerr << "ERROR: stride must be a multiple of " << sizeof(void*)
+              << " bytes" << std::endl;
+    return 1;
+  }
+  if (steps_per_octave < 1)
+  {
+    steps_per_octave = 1;
+  }
+
+  std::string how = "4KB pages";
+  std::uint64_t map_bytes = max_bytes;
+  char* p_buf = NULL;
+  if (huge_pages)
+  {
+    map_bytes = (max_bytes + HUGE_PAGE_BYTES - 1) & ~(HUGE_PAGE_BYTES - 1);
+    p_buf = mapHugeBuffer(map_bytes, how);
+  }
+  else
+  {
+    p_buf = mapUntouched(map_bytes);
+  }
+  if (p_buf == NULL)
+  {
+    std::cerr << "ERROR: mmap of " << formatBytes(map_bytes)
+              << " for latency test failed!" << std::endl;
+    return 1;
+  }
+  memset(p_buf, 0, map_bytes);
+
+  std::cout << "# pointer chase latency up to " << formatBytes(max_bytes)
+            << ", stride " << stride << " bytes, " << how << std::endl;
+  printCacheSizes(std::cout);
+  std::cout << "working_set_bytes,stride,cells,ns_per_load,p95_ns_per_load"
+            << counterCsvHeader() << std::endl;
+
+  std::mt19937_64 rng(12345);
+  const double ratio = std::pow(2.0, 1.0 / steps_per_octave);
+  std::uint64_t last = 0;
+  for (double size = 4096; size <= (double)max_bytes; size *= ratio)
+  {
+    std::uint64_t working_set = (std::uint64_t)size / stride * stride;
+    if (working_set == last || working_set / stride < 2)
+    {
+      continue;
+    }
+    last = working_set;
+
+    void** p_start = buildChaseRing(p_buf, working_set, stride, rng);
+    Stats stats = measureChase(p_start, working_set / stride, harness);
+    std::cout << working_set << "," << stride << "," << working_set / stride << ","
+              << stats.median * 1.0e9 << "," << stats.p95 * 1.0e9
+              << counterCsvFields(stats.counters) << std::endl;
+    recordResult("latency", "stride" + std::to_string(stride) + "/" +
+                 std::to_string(working_set), stats);
+  }
+
+  munmap(p_buf, map_bytes);
+  return 0;
+}
+
+/////////////
+// TLB reach
+//
+// The same random pointer chase, but with one cell per 4KB of span, so the
+// cache footprint is a single line per 4KB whatever the page size. Mapping
+// the span with 4KB, 2MB and 1GB pages then changes only how many pages the
+// chase touches; the step where the cost jumps is where the span outgrows a
+// TLB level. Spans past the cache size add cache misses, equally for every
+// page size.
+
+static const std::uint64_t TLB_CELL_STRIDE = 4096;
+
+struct TlbPageSize
+{
+  const char* name;
+  std::uint64_t bytes;
+};
+
+static const TlbPageSize TLB_PAGE_SIZES[] = {
+  { "4KB", 4096 },
+  { "2MB", 2 * 1024 * 1024 },
+  { "1GB", 1024 * 1024 * 1024 },
+};
+
+// map size_bytes backed by pages of exactly page_bytes where the system
+// allows it; describes what it got in how, NULL if the size is unavailable
+char* mapWithPageSize(std::uint64_t size_bytes, std::uint64_t page_bytes, std::string& how)
+{
+  if (page_bytes == 4096)
+  {
+    char* p_buf = mapUntouched(size_bytes);
+#ifdef MADV_NOHUGEPAGE
+    // THP set to "always" would quietly give us 2MB pages
+    if (p_buf != NULL)
+    {
+      madvise(p_buf, size_bytes, MADV_NOHUGEPAGE);
+    }
+#endif
+    how = "4KB pages";
+    return p_buf;
+  }
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+  const int log2_page = page_bytes == HUGE_PAGE_BYTES ? 21 : 30;
+  void* p = mmap(NULL, size_bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (log2_page << MAP_HUGE_SHIFT),
+                 -1, 0);
+  if (p != MAP_FAILED)
+  {
+    how = "hugetlbfs";
+    return (char*)p;
+  }
+#endif
+#ifdef MADV_HUGEPAGE
+  // transparent huge pages only come in 2MB
+  if (page_bytes == HUGE_PAGE_BYTES)
+  {
+    char* p_buf = mapUntouched(size_bytes);
+    if (p_buf != NULL && madvise(p_buf, size_bytes, MADV_HUGEPAGE) == 0)
+    {
+      how = "transparent huge pages";
+      return p_buf;
+    }
+    if (p_buf != NULL)
+    {
+      munmap(p_buf, size_bytes);
+    }
+  }
+#endif
+  return NULL;
+}
+
+int runTlbSweep(std::uint64_t max_bytes, int steps_per_octave, const Harness& harness)
+{
+  static const std::uint64_t min_bytes = 64 * 1024;
+  if (steps_per_octave < 1)
+  {
+    steps_per_octave = 1;
+  }
+  if (max_bytes < min_bytes)
+  {
+    std::cerr << "ERROR: TLB sweep needs at least " << formatBytes(min_bytes)
+              << std::endl;
+    return 1;
+  }
+
+  std::cout << "# TLB reach: random chase, one cell per " << TLB_CELL_STRIDE
+            << " bytes, spans " << formatBytes(min_bytes) << " .. "
+            << formatBytes(max_bytes) << std::endl;
+  printCacheSizes(std::cout);
+  std::cout << "page_size,span_bytes,pages,cells,ns_per_access,p95_ns_per_access"
+            << counterCsvHeader() << std::endl;
+
+  std::mt19937_64 rng(12345);
+  for (std::size_t s = 0; s < sizeof(TLB_PAGE_SIZES) / sizeof(TLB_PAGE_SIZES[0]); ++s)
+  {
+    const TlbPageSize& page = TLB_PAGE_SIZES[s];
+    const std::uint64_t map_bytes = (max_bytes + page.bytes - 1) / page.bytes * page.bytes;
+    std::string how;
+    char* p_buf = mapWithPageSize(map_bytes, page.bytes, how);
+    if (p_buf == NULL)
+    {
+      std::cout << "# " << page.name << " pages: skipped (reserve them in"
+                << " /sys/kernel/mm/hugepages/hugepages-"
+                << page.bytes / 1024 << "kB/nr_hugepages)" << std::endl;
+      continue;
+    }
+    memset(p_buf, 0, map_bytes);
+    std::cout << "# " << page.name << " pages: " << how << std::endl;
+
+    const double ratio = std::pow(2.0, 1.0 / steps_per_octave);
+    std::uint64_t last = 0;
+    for (double size = min_bytes; size <= (double)max_bytes * 1.0001; size *= ratio)
+    {
+      const std::uint64_t span = (std::uint64_t)size / TLB_CELL_STRIDE * TLB_CELL_STRIDE;
+      if (span == last)
+      {
+        continue;
+      }
+      last = span;
+
+      const std::uint64_t cells = span / TLB_CELL_STRIDE;
+      const std::uint64_t pages = (span + page.bytes - 1) / page.bytes;
+      void** p_start = buildChaseRing(p_buf, span, TLB_CELL_STRIDE, rng, 64);
+      Stats stats = measureChase(p_start, cells, harness);
+      std::cout << page.name << "," << span << "," << pages << "," << cells << ","
+                << stats.median * 1.0e9 << "," << stats.p95 * 1.0e9
+                << counterCsvFields(stats.counters) << std::endl;
+      recordResult("tlb", std::string(page.name) + "/" + std::to_string(span), stats);
+    }
+
+    munmap(p_buf, map_bytes);
+  }
+  return 0;
+}
+
+/////////////
+// allocation strategies
+//
+// The default test times malloc and then memset, so the page faults of the
+// first touch end up in the memset number. Here every strategy reports the
+// allocation call, the first touch and the steady state separately; the
+// fault cost is whatever the first two took beyond a steady state pass.
+
+struct AllocStrategy
+{
+  const char* name;
+  // returns NULL if the strategy isn't available; sizeBytes may be rounded up
+  char* (*allocate)(std::uint64_t& sizeBytes);
+  void (*release)(char* p, std::uint64_t sizeBytes);
+  // touch every page before the first timed pass
+  bool prefault;
+};
+
+char* allocMalloc(std::uint64_t& sizeBytes)
+{
+  return (char*)malloc(sizeBytes);
+}
+
+void releaseMalloc(char* p, std::uint64_t)
+{
+  free(p);
+}
+
+char* allocPopulate(std::uint64_t& sizeBytes)
+{
+#ifdef MAP_POPULATE
+  void* p = mmap(NULL, sizeBytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+  return p == MAP_FAILED ? NULL : (char*)p;
+#else
+  (void)sizeBytes;
+  return NULL;
+#endif
+}
+
+char* allocThp(std::uint64_t& sizeBytes)
+{
+#ifdef MADV_HUGEPAGE
+  sizeBytes = (sizeBytes + HUGE_PAGE_BYTES - 1) & ~(HUGE_PAGE_BYTES - 1);
+  char* p = mapUntouched(sizeBytes);
+  if (p != NULL && madvise(p, sizeBytes, MADV_HUGEPAGE) != 0)
+  {
+    munmap(p, sizeBytes);
+    return NULL;
+  }
+  return p;
+#else
+  (void)sizeBytes;
+  return NULL;
+#endif
+}
+
+char* allocHugetlb(std::uint64_t& sizeBytes)
+{
+#ifdef MAP_HUGETLB
+  sizeBytes = (sizeBytes + HUGE_PAGE_BYTES - 1) & ~(HUGE_PAGE_BYTES - 1);
+  void* p = mmap(NULL, sizeBytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  return p == MAP_FAILED ? NULL : (char*)p;
+#else
+  (void)sizeBytes;
+  return NULL;
+#endif
+}
+
+void releaseMmap(char* p, std::uint64_t sizeBytes)
+{
+  munmap(p, sizeBytes);
+}
+
+const AllocStrategy ALLOC_STRATEGIES[] = {
+  { "malloc", allocMalloc, releaseMalloc, false },
+  { "malloc+prefault", allocMalloc, releaseMalloc, true },
+  { "mmap+MAP_POPULATE", allocPopulate, releaseMmap, false },
+  { "mmap+MADV_HUGEPAGE", allocThp, releaseMmap, false },
+  { "mmap+MAP_HUGETLB", allocHugetlb, releaseMmap, false },
+};
+
+// AnonHugePages of the whole process in KB, or -1 if the kernel is too old
+// to have smaps_rollup
+long anonHugePagesKb()
+{
+  std::ifstream smaps("/proc/self/smaps_rollup");
+  std::string key;
+  long value = 0;
+  while (smaps >> key)
+  {
+    if (key == "AnonHugePages:" && smaps >> value)
+    {
+      return value;
+    }
+  }
+  return -1;
+}
+
+int runAllocStrategies(std::uint64_t size_bytes, const Harness& harness)
+{
+  // memcpy source, faulted in up front so it never contributes faults
+  char* p_src = (char*)malloc(size_bytes);
+  if (p_src == NULL)
+  {
+    std::cerr << "ERROR: malloc of " << formatBytes(size_bytes)
+              << " for alloc test returned NULL!" << std::endl;
+    return 1;
+  }
+  memset(p_src, 0xF, size_bytes);
+
+  const std::uint64_t page = sysconf(_SC_PAGESIZE);
+  std::cout << "Allocation strategies for " << formatBytes(size_bytes) << ":"
+            << std::endl;
+
+  for (std::size_t s = 0; s < sizeof(ALLOC_STRATEGIES) / sizeof(ALLOC_STRATEGIES[0]); ++s)
+  {
+    const AllocStrategy& strategy = ALLOC_STRATEGIES[s];
+    std::cout << std::endl << strategy.name << ":" << std::endl;
+
+    long huge_before = anonHugePagesKb();
+    std::uint64_t map_bytes = size_bytes;
+    Timer timer;
+    char* p_buf = strategy.allocate(map_bytes);
+    double alloc_seconds = timer.elapsedSec();
+    if (p_buf == NULL)
+    {
+      std::cout << "  skipped (not available on this system";
+      if (strategy.allocate == allocHugetlb)
+      {
+        std::cout << ", reserve pages in /proc/sys/vm/nr_hugepages";
+      }
+      std::cout << ")" << std::endl;
+      continue;
+    }
+
+    // counters cover everything that faults: allocation, prefault and the
+    // first memset
+    CounterSample counters_before = counterSnapshot();
+    double prefault_seconds = 0.0;
+    if (strategy.prefault)
+    {
+      timer.update();
+      for (std::uint64_t offset = 0; offset < size_bytes; offset += page)
+      {
+        p_buf[offset] = 0;
+      }
+      clobberMemory(p_buf);
+      prefault_seconds = timer.elapsedSec();
+    }
+
+    double first_touch_seconds = runBandwidthOp(OP_MEMSET, p_buf, p_src, size_bytes, 1);
+    CounterSample fault_counters = counterDelta(counters_before, counterSnapshot(), 1);
+
+    Stats memset_stats = measure(harness, [&]()
+    {
+      runBandwidthOp(OP_MEMSET, p_buf, p_src, size_bytes, 1);
+    });
+    Stats memcpy_stats = measure(harness, [&]()
+    {
+      runBandwidthOp(OP_MEMCPY, p_buf, p_src, size_bytes, 1);
+    });
+    const double memset_seconds = memset_stats.median;
+    long huge_after = anonHugePagesKb();
+
+    double fault_seconds = std::max(
+        0.0, alloc_seconds + prefault_seconds + first_touch_seconds - memset_seconds);
+    std::cout << "  alloc " << alloc_seconds * 1.0e3 << "ms";
+    if (strategy.prefault)
+    {
+      std::cout << ", prefault " << prefault_seconds * 1.0e3 << "ms";
+    }
+    std::cout << ", first memset " << first_touch_seconds * 1.0e3 << "ms" << std::endl
+              << "  fault cost " << fault_seconds * 1.0e3 << "ms ("
+              << fault_seconds * 1.0e9 / (size_bytes / page) << "ns per 4KB page)"
+              << std::endl;
+    if (hasCounters(fault_counters))
+    {
+      std::cout << "  fault phase counters: " << formatCounters(fault_counters)
+                << std::endl;
+    }
+    std::cout
+              << "  steady memset " << formatStats(memset_stats, size_bytes) << std::endl
+              << "  steady memcpy " << formatStats(memcpy_stats, size_bytes) << std::endl;
+    if (huge_before >= 0 && huge_after >= 0)
+    {
+      std::cout << "  transparent huge pages gained: "
+                << formatBytes((std::uint64_t)std::max(0L, huge_after - huge_before) * 1024)
+                << std::endl;
+    }
+
+    const std::string name = strategy.name;
+    recordValue("alloc", name + "/alloc", alloc_seconds);
+    if (strategy.prefault)
+    {
+      recordValue("alloc", name + "/prefault", prefault_seconds);
+    }
+    recordValue("alloc", name + "/first_memset", first_touch_seconds);
+    recordValue("alloc", name + "/fault", fault_seconds);
+    recordResult("alloc", name + "/memset", memset_stats, size_bytes);
+    recordResult("alloc", name + "/memcpy", memcpy_stats, size_bytes);
+
+    strategy.release(p_buf, map_bytes);
+  }
+
+  free(p_src);
+  return 0;
+}
+
+/////////////
+// allocator stress
+//
+// Threads churn through malloc/free of mixed sizes for a fixed time while the
+// main thread samples throughput, RSS and the bytes actually live, so a slow
+// allocator and one that hoards memory both show up. Nothing here is tied to
+// glibc; run it under LD_PRELOAD=libjemalloc.so (or tcmalloc, mimalloc) to
+// compare allocators on the same size stream.
+
+static const std::size_t STRESS_SLOTS = 1 << 14;
+static const std::size_t STRESS_TABLE = 1 << 16;
+static const double STRESS_INTERVAL_SECONDS = 0.25;
+// synthetic sizes follow a power law: P(size > x) ~ (min / x)^alpha
+static const double STRESS_ALPHA = 1.0;
+static const std::size_t STRESS_MIN_BYTES = 16;
+static const std::size_t STRESS_MAX_BYTES = 256 * 1024;
+
+struct StressThread
+{
+  std::atomic<std::uint64_t> ops;
+  std::atomic<std::int64_t> liveBytes;
+  // keep the counters of neighbouring threads off each other's lines
+  char pad[128 - sizeof(std::atomic<std::uint64_t>) - sizeof(std::atomic<std::int64_t>)];
+};
+
+// resident set size in bytes, from /proc/self/statm
+std::uint64_t residentBytes()
+{
+  std::ifstream statm("/proc/self/statm");
+  std::uint64_t size = 0;
+  std::uint64_t resident = 0;
+  statm >> size >> resident;
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+// first number on every line of a trace, '#' starts a comment
+bool loadSizeTrace(const std::string& path, std::vector<std::uint32_t>& sizes)
+{
+  std::ifstream in(path.c_str());
+  if (!in)
+  {
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line))
+  {
+    std::istringstream fields(line);
+    std::uint64_t size;
+    if (line.empty() || line[0] == '#' || !(fields >> size))
+    {
+      continue;
+    }
+    sizes.push_back((std::uint32_t)std::min<std::uint64_t>(std::max<std::uint64_t>(size, 1),
+                                                          0xFFFFFFFF));
+  }
+  return !sizes.empty();
+}
+
+void stressWorker(const std::vector<std::uint32_t>& sizes, std::size_t first,
+                  unsigned seed, const std::atomic<bool>& stop, StressThread& counters)
+{
+  std::vector<char*> slots(STRESS_SLOTS, (char*)NULL);
+  std::vector<std::uint32_t> slot_bytes(STRESS_SLOTS, 0);
+
+  // random slots are drawn up front so the loop only measures the allocator
+  std::mt19937 rng(seed);
+  std::vector<std::uint32_t> picks(STRESS_TABLE);
+  for (std::size_t i = 0; i < picks.size(); ++i)
+  {
+    picks[i] = rng() % STRESS_SLOTS;
+  }
+
+  std::size_t next = first;
+  std::uint64_t ops = 0;
+  std::int64_t live = 0;
+  while (!stop.load(std::memory_order_relaxed))
+  {
+    for (std::size_t i = 0; i < 256; ++i, ++next)
+    {
+      const std::uint32_t slot = picks[next % STRESS_TABLE];
+      if (slots[slot] != NULL)
+      {
+        free(slots[slot]);
+        live -= slot_bytes[slot];
+        ++ops;
+      }
+      const std::uint32_t size = sizes[next % sizes.size()];
+      char* p = (char*)malloc(size);
+      if (p == NULL)
+      {
+        slots[slot] = NULL;
+        continue;
+      }
+      // touch every page so RSS reflects the live bytes, not just headers
+      for (std::uint32_t offset = 0; offset < size; offset += 4096)
+      {
+        p[offset] = 1;
+      }
+      p[size - 1] = 1;
+      slots[slot] = p;
+      slot_bytes[slot] = size;
+      live += size;
+      ++ops;
+    }
+    counters.ops.store(ops, std::memory_order_relaxed);
+    counters.liveBytes.store(live, std::memory_order_relaxed);
+  }
+
+  for (std::size_t slot = 0; slot < STRESS_SLOTS; ++slot)
+  {
+    free(slots[slot]);
+  }
+  counters.liveBytes.store(0, std::memory_order_relaxed);
+}
+
+int runAllocatorStress(int num_threads, double duration_seconds,
+                       const std::string& trace_path)
+{
+  if (num_threads <= 0)
+  {
+    num_threads = (int)allowedCpus().size();
+  }
+  if (duration_seconds <= 0.0)
+  {
+    std::cerr << "ERROR: --duration must be positive" << std::endl;
+    return 1;
+  }
+
+  std::vector<std::uint32_t> sizes;
+  if (!trace_path.empty())
+  {
+    if (!loadSizeTrace(trace_path, sizes))
+    {
+      std::cerr << "ERROR: no sizes in trace " << trace_path << std::endl;
+      return 1;
+    }
+  }
+  else
+  {
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    for (std::size_t i = 0; i < STRESS_TABLE; ++i)
+    {
+      double size = STRESS_MIN_BYTES / std::pow(1.0 - uniform(rng), 1.0 / STRESS_ALPHA);
+      sizes.push_back((std::uint32_t)std::min<double>(size, STRESS_MAX_BYTES));
+    }
+  }
+  std::uint64_t total = 0;
+  for (std::size_t i = 0; i < sizes.size(); ++i)
+  {
+    total += sizes[i];
+  }
+
+  const char* p_preload = getenv("LD_PRELOAD");
+  std::cout << "# allocator stress: " << num_threads << " threads, "
+            << duration_seconds << "s, " << STRESS_SLOTS << " slots per thread" << std::endl
+            << "# allocator: "
+            << (p_preload != NULL && *p_preload ? p_preload : "libc malloc") << std::endl
+            << "# sizes: ";
+  if (trace_path.empty())
+  {
+    std::cout << "power law alpha " << STRESS_ALPHA << ", " << STRESS_MIN_BYTES << " .. "
+              << STRESS_MAX_BYTES << " bytes";
+  }
+  else
+  {
+    std::cout << sizes.size() << " from " << trace_path;
+  }
+  std::cout << ", mean " << total / sizes.size() << " bytes" << std::endl
+            << "time_s,ops_per_s,rss_bytes,live_bytes,rss_per_live_byte" << std::endl;
+
+  const std::uint64_t rss_start = residentBytes();
+  std::vector<StressThread> counters(num_threads);
+  std::atomic<bool> stop(false);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t)
+  {
+    counters[t].ops.store(0);
+    counters[t].liveBytes.store(0);
+    threads.push_back(std::thread(stressWorker, std::cref(sizes),
+                                  t * (STRESS_TABLE / num_threads), 1000u + t,
+                                  std::cref(stop), std::ref(counters[t])));
+  }
+
+  std::vector<double> rates;
+  std::uint64_t rss_peak = rss_start;
+  std::uint64_t last_ops = 0;
+  double rss_per_live = 0.0;
+  Timer timer;
+  std::uint64_t last_ns = nowNs();
+  while (timer.elapsedSec() < duration_seconds)
+  {
+    std::this_thread::sleep_for(std::chrono::duration<double>(STRESS_INTERVAL_SECONDS));
+    std::uint64_t ops = 0;
+    std::int64_t live = 0;
+    for (int t = 0; t < num_threads; ++t)
+    {
+      ops += counters[t].ops.load(std::memory_order_relaxed);
+      live += counters[t].liveBytes.load(std::memory_order_relaxed);
+    }
+    const std::uint64_t now = nowNs();
+    const std::uint64_t rss = residentBytes();
+    const double rate = (ops - last_ops) / ((now - last_ns) / 1.0e9);
+    // heap growth over the bytes the program asked for and still holds
+    rss_per_live = live > 0 ? (double)(rss - std::min(rss, rss_start)) / live : 0.0;
+    rss_peak = std::max(rss_peak, rss);
+    rates.push_back(rate);
+    last_ops = ops;
+    last_ns = now;
+    std::cout << timer.elapsedSec() << "," << rate << "," << rss << "," << live << ","
+              << rss_per_live << std::endl;
+  }
+  stop.store(true);
+  for (std::size_t t = 0; t < threads.size(); ++t)
+  {
+    threads[t].join();
+  }
+  const std::uint64_t rss_end = residentBytes();
+
+  Stats stats = summarize(rates);
+  std::cout << "# ops/s: median " << stats.median << ", min " << stats.min << ", max "
+            << stats.max << " over " << stats.samples << " intervals" << std::endl
+            << "# rss: start " << formatBytes(rss_start) << ", peak "
+            << formatBytes(rss_peak) << ", after freeing everything "
+            << formatBytes(rss_end) << std::endl;
+
+  recordResult("allocator", "ops_per_s", stats, 0, "ops/s", false);
+  recordValue("allocator", "rss_growth", (double)(rss_peak - rss_start), "B");
+  recordValue("allocator", "rss_per_live_byte", rss_per_live, "ratio");
+  recordValue("allocator", "rss_retained", (double)(rss_end - std::min(rss_end, rss_start)),
+              "B");
+  return 0;
+}
+
+/////////////
+// STREAM style kernels
+//
+// Copy/Scale/Add/Triad as in McCalpin's STREAM, plus a pure read reduction,
+// a pure write and a configurable read:write mix. The loops walk fixed blocks
+// of STREAM_BLOCK doubles so gcc vectorizes them even at -O2, and
+// target_clones picks the widest vector unit when the binary loads.
+
+static const std::size_t STREAM_BLOCK = 16;
+// the mixed kernel alternates between reading and writing whole 4KB chunks
+static const std::size_t STREAM_CHUNK = 512;
+
+#if defined(MEMTEST_X86) && defined(__GNUC__)
+#define MEMTEST_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define MEMTEST_CLONES
+#endif
+
+MEMTEST_CLONES
+void streamCopy(double* __restrict c, const double* __restrict a, std::size_t n)
+{
+  for (std::size_t i = 0; i < n; i += STREAM_BLOCK)
+    for (std::size_t j = 0; j < STREAM_BLOCK; ++j)
+      c[i + j] = a[i + j];
+}
+
+MEMTEST_CLONES
+void streamScale(double* __restrict b, const double* __restrict c, double q,
+                 std::size_t n)
+{
+  for (std::size_t i = 0; i < n; i += STREAM_BLOCK)
+    for (std::size_t j = 0; j < STREAM_BLOCK; ++j)
+      b[i + j] = q * c[i + j];
+}
+
+MEMTEST_CLONES
+void streamAdd(double* __restrict c, const double* __restrict a,
+               const double* __restrict b, std::size_t n)
+{
+  for (std::size_t i = 0; i < n; i += STREAM_BLOCK)
+    for (std::size_t j = 0; j < STREAM_BLOCK; ++j)
+      c[i + j] = a[i + j] + b[i + j];
+}
+
+MEMTEST_CLONES
+void streamTriad(double* __restrict a, const double* __restrict b,
+                 const double* __restrict c, double q, std::size_t n)
+{
+  for (std::size_t i = 0; i < n; i += STREAM_BLOCK)
+    for (std::size_t j = 0; j < STREAM_BLOCK; ++j)
+      a[i + j] = b[i + j] + q * c[i + j];
+}
+
+// one accumulator per lane, so the reduction needs no reassociation to vectorize
+MEMTEST_CLONES
+double streamRead(const double* __restrict a, std::size_t n)
+{
+  double sums[STREAM_BLOCK] = {};
+  for (std::size_t i = 0; i < n; i += STREAM_BLOCK)
+    for (std::size_t j = 0; j < STREAM_BLOCK; ++j)
+      sums[j] += a[i + j];
+
+  double sum = 0.0;
+  for (std::size_t j = 0; j < STREAM_BLOCK; ++j)
+  {
+    sum += sums[j];
+  }
+  return sum;
+}
+
+MEMTEST_CLONES
+void streamWrite(double* __restrict c, double q, std::size_t n)
+{
+  for (std::size_t i = 0; i < n; i += STREAM_BLOCK)
+    for (std::size_t j = 0; j < STREAM_BLOCK; ++j)
+      c[i + j] = q;
+}
+
+// rounds of `reads` chunks read from src followed by `writes` chunks written
+// to dst
+MEMTEST_CLONES
+double streamMixed(double* __restrict dst, const double* __restrict src,
+                   std::size_t rounds, int reads, int writes, double q)
+{
+  double sums[STREAM_BLOCK] = {};
+  for (std::size_t r = 0; r < rounds; ++r)
+  {
+    for (int k = 0; k < reads; ++k, src += STREAM_CHUNK)
+      for (std::size_t i = 0; i < STREAM_CHUNK; i += STREAM_BLOCK)
+        for (std::size_t j = 0; j < STREAM_BLOCK; ++j)
+          sums[j] += src[i + j];
+    for (int k = 0; k < writes; ++k, dst += STREAM_CHUNK)
+      for (std::size_t i = 0; i < STREAM_CHUNK; i += STREAM_BLOCK)
+        for (std::size_t j = 0; j < STREAM_BLOCK; ++j)
+          dst[i + j] = q;
+  }
+
+  double sum = 0.0;
+  for (std::size_t j = 0; j < STREAM_BLOCK; ++j)
+  {
+    sum += sums[j];
+  }
+  return sum;
+}
+
+int runStream(std::uint64_t size_bytes, int num_threads, int reads, int writes,
+              const Harness& harness)
+{
+  std::vector<int> cpus = allowedCpus();
+  if (num_threads < 0)
+  {
+    num_threads = 1;
+  }
+  else if (num_threads == 0)
+  {
+    num_threads = (int)cpus.size();
+  }
+  if (reads < 0 || writes < 0 || reads + writes == 0)
+  {
+    std::cerr << "ERROR: read:write ratio needs a non-zero side" << std::endl;
+    return 1;
+  }
+
+  // three arrays share the buffer size; slices are whole 4KB chunks so the
+  // threads never share a page
+  std::uint64_t slice = size_bytes / 3 / sizeof(double) / num_threads;
+  slice -= slice % STREAM_CHUNK;
+  if (slice == 0)
+  {
+    std::cerr << "ERROR: " << formatBytes(size_bytes) << " is too small for "
+              << num_threads << " threads" << std::endl;
+    return 1;
+  }
+  const std::uint64_t n = slice * num_threads;
+  const std::uint64_t array_bytes = n * sizeof(double);
+
+  double* a = (double*)mapUntouched(array_bytes);
+  double* b = (double*)mapUntouched(array_bytes);
+  double* c = (double*)mapUntouched(array_bytes);
+  if (a == NULL || b == NULL || c == NULL)
+  {
+    std::cerr << "ERROR: mmap of 3x " << formatBytes(array_bytes)
+              << " for stream test failed!" << std::endl;
+    if (a != NULL) munmap(a, array_bytes);
+    if (b != NULL) munmap(b, array_bytes);
+    if (c != NULL) munmap(c, array_bytes);
+    return 1;
+  }
+
+  // first touch from the owning threads
+  Harness once;
+  once.warmup = 0;
+  once.reps = 1;
+  runLockstep(cpus, num_threads, once, [&](int t)
+  {
+    for (std::uint64_t i = t * slice; i < (t + 1) * slice; ++i)
+    {
+      a[i] = 1.0;
+      b[i] = 2.0;
+      c[i] = 0.0;
+    }
+  });
+
+  std::cout << "STREAM: " << num_threads << " threads, 3 arrays of "
+            << formatBytes(array_bytes) << " (" << n << " doubles)" << std::endl;
+
+  const double q = 3.0;
+  std::vector<double> sinks(num_threads);
+  const std::size_t chunks_per_round = std::max(reads, writes);
+  const std::uint64_t rounds = slice / (STREAM_CHUNK * chunks_per_round);
+
+  struct StreamTest
+  {
+    const char* name;
+    int kernel;
+    std::uint64_t bytes;
+  };
+  const StreamTest tests[] = {
+    { "copy", 0, 2 * array_bytes },
+    { "scale", 1, 2 * array_bytes },
+    { "add", 2, 3 * array_bytes },
+    { "triad", 3, 3 * array_bytes },
+    { "read", 4, array_bytes },
+    { "write", 5, array_bytes },
+    { "mixed", 6, rounds * (reads + writes) * STREAM_CHUNK * sizeof(double) * num_threads },
+  };
+
+  for (std::size_t k = 0; k < sizeof(tests) / sizeof(tests[0]); ++k)
+  {
+    const StreamTest& test = tests[k];
+    if (test.bytes == 0)
+    {
+      std::cout << "  " << test.name << ": skipped, slices too small for "
+                << reads << ":" << writes << std::endl;
+      continue;
+    }
+
+    LockstepRun run = runLockstep(cpus, num_threads, harness, [&](int t)
+    {
+      const std::uint64_t lo = t * slice;
+      switch (test.kernel)
+      {
+        case 0: streamCopy(c + lo, a + lo, slice); break;
+        case 1: streamScale(b + lo, c + lo, q, slice); break;
+        case 2: streamAdd(c + lo, a + lo, b + lo, slice); break;
+        case 3: streamTriad(a + lo, b + lo, c + lo, q, slice); break;
+        case 4: sinks[t] += streamRead(a + lo, slice); break;
+        case 5: streamWrite(c + lo, q, slice); break;
+        case 6: sinks[t] += streamMixed(c + lo, a + lo, rounds, reads, writes, q); break;
+      }
+    });
+
+    std::cout << "  " << test.name;
+    if (test.kernel == 6)
+    {
+      std::cout << " " << reads << ":" << writes;
+    }
+    const Stats& stats = run.aggregate;
+    std::cout << ": " << formatStats(stats, test.bytes) << std::endl;
+
+    std::string name = test.name;
+    if (test.kernel == 6)
+    {
+      name += std::to_string(reads) + ":" + std::to_string(writes);
+    }
+    recordResult("stream", name, stats, test.bytes);
+  }
+
+  // keep the reductions observable
+  double sink = 0.0;
+  for (int t = 0; t < num_threads; ++t)
+  {
+    sink += sinks[t];
+  }
+  clobberMemory(&sink);
+
+  munmap(a, array_bytes);
+  munmap(b, array_bytes);
+  munmap(c, array_bytes);
+  return 0;
+}
+
+/////////////
+// misaligned and overlapping copies
+//
+// Small copies at every source/destination offset within a cache line, and
+// memmove with the destination overlapping the source from either side.
+// The output is one CSV row per cell, so it can be pivoted straight into a
+// heatmap of size x src_align x dst_align or size x overlap.
+
+static const std::size_t MATRIX_MAX_BYTES = 4096;
+
+int runMisalignMatrix(int align_step, const Harness& harness)
+{
+  if (align_step < 1)
+  {
+    align_step = 1;
+  }
+
+  // page aligned bases, so an offset is the misalignment to lines and pages
+  const std::size_t page = sysconf(_SC_PAGESIZE);
+  const std::size_t buf_bytes = 3 * page + MATRIX_MAX_BYTES;
+  void* p_src_buf = NULL;
+  void* p_dest_buf = NULL;
+  if (posix_memalign(&p_src_buf, page, buf_bytes) != 0 ||
+      posix_memalign(&p_dest_buf, page, buf_bytes) != 0)
+  {
+    std::cerr << "ERROR: posix_memalign for misalign test failed!" << std::endl;
+    free(p_src_buf);
+    return 1;
+  }
+  char* p_src = (char*)p_src_buf;
+  char* p_dest = (char*)p_dest_buf;
+  memset(p_src, 0xF, buf_bytes);
+  memset(p_dest, 0xF, buf_bytes);
+
+  std::vector<std::size_t> sizes;
+  for (std::size_t size = 1; size <= MATRIX_MAX_BYTES; size *= 2)
+  {
+    sizes.push_back(size);
+  }
+
+  std::cout << "# misaligned/overlapping copies, 1B .. "
+            << formatBytes(MATRIX_MAX_BYTES) << ", alignment step " << align_step
+            << std::endl
+            << "# overlap > 0: destination above source (copies backwards),"
+            << " overlap < 0: destination below source" << std::endl
+            << "test,op,size_bytes,src_align,dst_align,overlap,ns_per_call,gbps"
+            << counterCsvHeader() << std::endl;
+
+  // distinct buffers at every pair of offsets
+  for (int op = OP_MEMCPY; op <= OP_MEMMOVE; ++op)
+  {
+    for (std::size_t i = 0; i < sizes.size(); ++i)
+    {
+      const std::size_t size = sizes[i];
+      for (int src_align = 0; src_align < 64; src_align += align_step)
+      {
+        for (int dst_align = 0; dst_align < 64; dst_align += align_step)
+        {
+          char* p_s = p_src + src_align;
+          char* p_d = p_dest + dst_align;
+          Stats stats = perCallStats(harness, [&]()
+          {
+            if (op == OP_MEMCPY)
+            {
+              memcpy(p_d, p_s, size);
+            }
+            else
+            {
+              doMemmove(p_d, p_s, size);
+            }
+            clobberMemory(p_d);
+          });
+          const double ns = stats.median * 1.0e9;
+          std::cout << "align," << bandwidthOpName(op) << "," << size << ","
+                    << src_align << "," << dst_align << ",0," << ns << ","
+                    << size / ns << counterCsvFields(stats.counters) << std::endl;
+          recordResult("misalign", "align/" + std::string(bandwidthOpName(op)) + "/" +
+                       std::to_string(size) + "/" + std::to_string(src_align) + "/" +
+                       std::to_string(dst_align), stats, size);
+        }
+      }
+    }
+  }
+
+  // one buffer, destination shifted by +-distance; distances are 2^k and
+  // 2^k - 1 so both aligned and odd shifts show up
+  char* p_base = p_src + page;
+  for (std::size_t i = 0; i < sizes.size(); ++i)
+  {
+    const std::size_t size = sizes[i];
+    std::vector<std::size_t> distances;
+    for (std::size_t d = 1; d < size; d *= 2)
+    {
+      if (d > 2)
+      {
+        distances.push_back(d - 1);
+      }
+      distances.push_back(d);
+    }
+
+    for (std::size_t k = 0; k < distances.size(); ++k)
+    {
+      for (int sign = 1; sign >= -1; sign -= 2)
+      {
+        const std::size_t d = distances[k];
+        char* p_s = sign > 0 ? p_base : p_base + d;
+        char* p_d = sign > 0 ? p_base + d : p_base;
+        Stats stats = perCallStats(harness, [&]()
+        {
+          doMemmove(p_d, p_s, size);
+          clobberMemory(p_d);
+        });
+        const double ns = stats.median * 1.0e9;
+        std::cout << "overlap,memmove," << size << ",0,0," << sign * (long)d << ","
+                  << ns << "," << size / ns << counterCsvFields(stats.counters)
+                  << std::endl;
+        recordResult("misalign", "overlap/memmove/" + std::to_string(size) + "/" +
+                     std::to_string(sign * (long)d), stats, size);
+      }
+    }
+  }
+
+  free(p_src);
+  free(p_dest);
+  return 0;
+}
+
+/////////////
+// zero-copy alternatives
+//
+// Moves the same bytes with memcpy and with the kernel interfaces that avoid
+// a user space copy: mremap hands the pages themselves to a new address,
+// vmsplice maps them into a pipe that is spliced on to /dev/null without
+// being touched (vmsplice+read reads the pipe back into a buffer instead,
+// which is a copy and is labelled as one), copy_file_range
+// copies between two tmpfs files (memfds) without the data passing through
+// user space, and process_vm_readv pulls them straight out of another
+// process. Every size reports latency per call and throughput, next to
+// memcpy at the same size.
+
+struct ZeroCopyContext
+{
+  std::uint64_t maxBytes;
+  char* pSrc;
+  char* pDest;
+  // mremap moves its pages between these two and back
+  char* pRemapHere;
+  char* pRemapThere;
+  int pipeFds[2];
+  std::uint64_t pipeBytes;
+  // consumer for the pipe that takes the pages without copying them
+  int devNullFd;
+  int memfdIn;
+  int memfdOut;
+  pid_t child;
+};
+
+bool zeroCopyMemcpy(ZeroCopyContext& context, std::uint64_t size_bytes)
+{
+  memcpy(context.pDest, context.pSrc, size_bytes);
+  clobberMemory(context.pDest);
+  return true;
+}
+
+bool zeroCopyMremap(ZeroCopyContext& context, std::uint64_t size_bytes)
+{
+  void* p = mremap(context.pRemapHere, size_bytes, size_bytes,
+                   MREMAP_MAYMOVE | MREMAP_FIXED, context.pRemapThere);
+  if (p == MAP_FAILED)
+  {
+    return false;
+  }
+  std::swap(context.pRemapHere, context.pRemapThere);
+  return true;
+}
+
+// Each move leaves a hole behind and swaps the two pointers, and how many
+// calls a measurement makes decides which way round they end up. Before a
+// new size both ranges go back to a fully populated read/write source and
+// a PROT_NONE reservation, or the first moves of the larger size would
+// take part of the previous size's pages plus untouched reservation.
+bool prepareMremap(ZeroCopyContext& context, std::uint64_t size_bytes)
+{
+  void* p_here = mmap(context.pRemapHere, context.maxBytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+  void* p_there = mmap(context.pRemapThere, context.maxBytes, PROT_NONE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+  if (p_here == MAP_FAILED || p_there == MAP_FAILED)
+  {
+    return false;
+  }
+  memset(context.pRemapHere, 0xF, size_bytes);
+  return true;
+}
+
+// after the calls the source range has to be the pages that were filled,
+// all resident and still holding the data, wherever it ended up
+bool verifyMremap(ZeroCopyContext& context, std::uint64_t size_bytes)
+{
+  const std::uint64_t page = sysconf(_SC_PAGESIZE);
+  std::vector<unsigned char> resident(size_bytes / page);
+  if (mincore(context.pRemapHere, size_bytes, &resident[0]) != 0)
+  {
+    return false;
+  }
+  for (std::size_t i = 0; i < resident.size(); ++i)
+  {
+    if (!(resident[i] & 1) || context.pRemapHere[i * page] != 0xF)
+    {
+      errno = EFAULT;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool zeroCopyVmsplice(ZeroCopyContext& context, std::uint64_t size_bytes)
+{
+  std::uint64_t offset = 0;
+  while (offset < size_bytes)
+  {
+    struct iovec iov;
+    iov.iov_base = context.pSrc + offset;
+    iov.iov_len = std::min(size_bytes - offset, context.pipeBytes);
+    ssize_t queued = vmsplice(context.pipeFds[1], &iov, 1, 0);
+    if (queued <= 0)
+    {
+      return false;
+    }
+    for (ssize_t done = 0; done < queued; )
+    {
+      ssize_t moved = splice(context.pipeFds[0], NULL, context.devNullFd, NULL,
+                             queued - done, SPLICE_F_MOVE);
+      if (moved <= 0)
+      {
+        return false;
+      }
+      done += moved;
+    }
+    offset += queued;
+  }
+  return true;
+}
+
+// the same, but the pipe is read back into user memory, so it is a copy
+bool zeroCopyVmspliceRead(ZeroCopyContext& context, std::uint64_t size_bytes)
+{
+  std::uint64_t offset = 0;
+  while (offset < size_bytes)
+  {
+    struct iovec iov;
+    iov.iov_base = context.pSrc + offset;
+    iov.iov_len = std::min(size_bytes - offset, context.pipeBytes);
+    ssize_t queued = vmsplice(context.pipeFds[1], &iov, 1, 0);
+    if (queued <= 0)
+    {
+      return false;
+    }
+    for (ssize_t done = 0; done < queued; )
+    {
+      ssize_t got = read(context.pipeFds[0], context.pDest + offset + done, queued - done);
+      if (got <= 0)
+      {
+        return false;
+      }
+      done += got;
+    }
+    offset += queued;
+  }
+  clobberMemory(context.pDest);
+  return true;
+}
+
+bool zeroCopyFileRange(ZeroCopyContext& context, std::uint64_t size_bytes)
+{
+  loff_t in_offset = 0;
+  loff_t out_offset = 0;
+  while ((std::uint64_t)in_offset < size_bytes)
+  {
+    ssize_t copied = copy_file_range(context.memfdIn, &in_offset, context.memfdOut,
+                                     &out_offset, size_bytes - in_offset, 0);
+    if (copied <= 0)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool zeroCopyProcessVm(ZeroCopyContext& context, std::uint64_t size_bytes)
+{
+  // the forked child has the source at the same address
+  std::uint64_t offset = 0;
+  while (offset < size_bytes)
+  {
+    struct iovec local;
+    local.iov_base = context.pDest + offset;
+    local.iov_len = size_bytes - offset;
+    struct iovec remote;
+    remote.iov_base = context.pSrc + offset;
+    remote.iov_len = size_bytes - offset;
+    ssize_t got = process_vm_readv(context.child, &local, 1, &remote, 1, 0);
+    if (got <= 0)
+    {
+      return false;
+    }
+    offset += got;
+  }
+  clobberMemory(context.pDest);
+  return true;
+}
+
+struct ZeroCopyMethod
+{
+  const char* name;
+  bool (*move)(ZeroCopyContext& context, std::uint64_t size_bytes);
+  // mremap can only move whole pages
+  bool wholePages;
+  // optional, before the calls at each size and to check them afterwards
+  bool (*prepare)(ZeroCopyContext& context, std::uint64_t size_bytes);
+  bool (*verify)(ZeroCopyContext& context, std::uint64_t size_bytes);
+};
+
+static const ZeroCopyMethod ZERO_COPY_METHODS[] = {
+  { "memcpy", zeroCopyMemcpy, false, NULL, NULL },
+  { "mremap", zeroCopyMremap, true, prepareMremap, verifyMremap },
+  { "vmsplice+splice", zeroCopyVmsplice, false, NULL, NULL },
+  { "vmsplice+read (copy)", zeroCopyVmspliceRead, false, NULL, NULL },
+  { "copy_file_range", zeroCopyFileRange, false, NULL, NULL },
+  { "process_vm_readv", zeroCopyProcessVm, false, NULL, NULL },
+};
+
+bool setUpZeroCopy(ZeroCopyContext& context, std::uint64_t max_bytes)
+{
+  context.maxBytes = max_bytes;
+  context.pipeFds[0] = context.pipeFds[1] = -1;
+  context.devNullFd = context.memfdIn = context.memfdOut = -1;
+  context.pSrc = mapUntouched(max_bytes);
+  context.pDest = mapUntouched(max_bytes);
+  context.pRemapHere = mapUntouched(max_bytes);
+  // reserved address space the mremap target lands in
+  void* p_there = mmap(NULL, max_bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  context.pRemapThere = p_there == MAP_FAILED ? NULL : (char*)p_there;
+  if (context.pSrc == NULL || context.pDest == NULL || context.pRemapHere == NULL ||
+      context.pRemapThere == NULL)
+  {
+    return false;
+  }
+  memset(context.pSrc, 0xF, max_bytes);
+  memset(context.pDest, 0xA, max_bytes);
+  memset(context.pRemapHere, 0xF, max_bytes);
+
+  context.pipeBytes = 0;
+  if (pipe(context.pipeFds) == 0)
+  {
+    // as big as /proc/sys/fs/pipe-max-size lets us, 1MB by default
+    fcntl(context.pipeFds[1], F_SETPIPE_SZ, 1024 * 1024);
+    int pipe_bytes = fcntl(context.pipeFds[1], F_GETPIPE_SZ);
+    context.pipeBytes = pipe_bytes > 0 ? pipe_bytes : 65536;
+  }
+  context.devNullFd = open("/dev/null", O_WRONLY);
+
+  // memfds live on tmpfs
+  context.memfdIn = memfd_create("memtest-in", 0);
+  context.memfdOut = memfd_create("memtest-out", 0);
+  if (context.memfdIn >= 0 && context.memfdOut >= 0)
+  {
+    for (std::uint64_t offset = 0; offset < max_bytes; )
+    {
+      ssize_t written = write(context.memfdIn, context.pSrc + offset, max_bytes - offset);
+      if (written <= 0)
+      {
+        break;
+      }
+      offset += written;
+    }
+    if (ftruncate(context.memfdOut, max_bytes) != 0)
+    {
+      close(context.memfdOut);
+      context.memfdOut = -1;
+    }
+  }
+
+  // a child that keeps a copy of the source and waits to be killed; only
+  // the source is shared, so writes elsewhere never hit copy-on-write
+  madvise(context.pDest, max_bytes, MADV_DONTFORK);
+  madvise(context.pRemapHere, max_bytes, MADV_DONTFORK);
+  madvise(context.pRemapThere, max_bytes, MADV_DONTFORK);
+  context.child = fork();
+  if (context.child == 0)
+  {
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    for (;;)
+    {
+      pause();
+    }
+  }
+  return true;
+}
+
+void tearDownZeroCopy(ZeroCopyContext& context)
+{
+  if (context.child > 0)
+  {
+    kill(context.child, SIGKILL);
+    waitpid(context.child, NULL, 0);
+  }
+  if (context.memfdIn >= 0) close(context.memfdIn);
+  if (context.memfdOut >= 0) close(context.memfdOut);
+  if (context.pipeFds[0] >= 0) close(context.pipeFds[0]);
+  if (context.pipeFds[1] >= 0) close(context.pipeFds[1]);
+  if (context.devNullFd >= 0) close(context.devNullFd);
+  if (context.pSrc != NULL) munmap(context.pSrc, context.maxBytes);
+  if (context.pDest != NULL) munmap(context.pDest, context.maxBytes);
+  if (context.pRemapHere != NULL) munmap(context.pRemapHere, context.maxBytes);
+  if (context.pRemapThere != NULL) munmap(context.pRemapThere, context.maxBytes);
+}
+
+int runZeroCopy(std::uint64_t max_bytes, int steps_per_octave, const Harness& harness)
+{
+  const std::uint64_t page = sysconf(_SC_PAGESIZE);
+  static const std::uint64_t min_bytes = 64;
+  if (steps_per_octave < 1)
+  {
+    steps_per_octave = 1;
+  }
+  max_bytes = (max_bytes + page - 1) / page * page;
+
+  ZeroCopyContext context = ZeroCopyContext();
+  if (!setUpZeroCopy(context, max_bytes))
+  {
+    std::cerr << "ERROR: mmap of 3x " << formatBytes(max_bytes)
+              << " for zero-copy test failed!" << std::endl;
+    tearDownZeroCopy(context);
+    return 1;
+  }
+
+  // steps between exact powers of two, rounded to the nearest cache line
+  // below a page and to the nearest page above, so mremap gets a size at
+  // every step from one page up; max_bytes itself always runs last
+  std::vector<std::uint64_t> sizes;
+  for (std::uint64_t octave = min_bytes; octave < max_bytes; octave *= 2)
+  {
+    for (int step = 0; step < steps_per_octave; ++step)
+    {
+      const double size = octave * std::pow(2.0, (double)step / steps_per_octave);
+      const std::uint64_t unit = size < page ? 64 : page;
+      const std::uint64_t rounded = (std::uint64_t)(size / unit + 0.5) * unit;
+      if (rounded < max_bytes && (sizes.empty() || rounded > sizes.back()))
+      {
+        sizes.push_back(rounded);
+      }
+    }
+  }
+  sizes.push_back(max_bytes);
+
+  const std::size_t num_methods = sizeof(ZERO_COPY_METHODS) / sizeof(ZERO_COPY_METHODS[0]);
+  std::vector<bool> available(num_methods, true);
+  for (std::size_t m = 0; m < num_methods; ++m)
+  {
+    if (!ZERO_COPY_METHODS[m].move(context, page))
+    {
+      std::cout << "# " << ZERO_COPY_METHODS[m].name << ": skipped ("
+                << strerror(errno) << ")" << std::endl;
+      available[m] = false;
+    }
+  }
+
+  std::cout << "# zero-copy alternatives, " << formatBytes(min_bytes) << " .. "
+            << formatBytes(max_bytes) << std::endl
+            << "method,size_bytes,ns_per_call,p95_ns_per_call,gbps,speedup_vs_memcpy"
+            << counterCsvHeader() << std::endl;
+
+  // smallest size from which each method stays ahead of memcpy
+  std::vector<std::uint64_t> pays_off(num_methods, 0);
+  std::vector<int> measured(num_methods, 0);
+  for (std::size_t i = 0; i < sizes.size(); ++i)
+  {
+    const std::uint64_t size = sizes[i];
+    double memcpy_seconds = 0.0;
+    for (std::size_t m = 0; m < num_methods; ++m)
+    {
+      const ZeroCopyMethod& method = ZERO_COPY_METHODS[m];
+      if (!available[m] || (method.wholePages && size % page != 0))
+      {
+        continue;
+      }
+      bool ok = method.prepare == NULL || method.prepare(context, size);
+      Stats stats = perCallStats(harness, [&]()
+      {
+        ok = method.move(context, size) && ok;
+      });
+      ok = ok && (method.verify == NULL || method.verify(context, size));
+      if (!ok)
+      {
+        std::cerr << "ERROR: " << method.name << " of " << size << " bytes failed: "
+                  << strerror(errno) << std::endl;
+        tearDownZeroCopy(context);
+        return 1;
+      }
+      ++measured[m];
+      if (m == 0)
+      {
+        memcpy_seconds = stats.median;
+      }
+      const double speedup = memcpy_seconds / stats.median;
+      if (speedup > 1.0 && pays_off[m] == 0)
+      {
+        pays_off[m] = size;
+      }
+      else if (speedup <= 1.0)
+      {
+        pays_off[m] = 0;
+      }
+      std::cout << method.name << "," << size << "," << stats.median * 1.0e9 << ","
+                << stats.p95 * 1.0e9 << "," << size / (stats.median * 1.0e9) << ","
+                << speedup << counterCsvFields(stats.counters) << std::endl;
+      recordResult("zerocopy", std::string(method.name) + "/" + std::to_string(size),
+                   stats, size);
+    }
+  }
+
+  std::cout << std::endl;
+  for (std::size_t m = 1; m < num_methods; ++m)
+  {
+    if (!available[m])
+    {
+      continue;
+    }
+    std::cout << "# " << ZERO_COPY_METHODS[m].name << ": ";
+    if (measured[m] == 0)
+    {
+      std::cout << "not measured at any of these sizes";
+    }
+    else if (pays_off[m] > 0)
+    {
+      std::cout << "faster than memcpy from " << formatBytes(pays_off[m]) << " up";
+    }
+    else
+    {
+      std::cout << "not faster than memcpy at the largest sizes";
+    }
+    std::cout << std::endl;
+  }
+
+  tearDownZeroCopy(context);
+  return 0;
+}
+
+/////////////
+// core to core cache line transfers
+//
+// Two pinned threads ping-pong one cache line for every pair of cpus, which
+// is the cost a lock-free queue pays per handoff. The false sharing demo has
+// the same pairs hammer two counters, once packed into one line and once
+// padded apart, and reports how much slower the packed layout is. Both come
+// out as cpu x cpu matrices; restrict the cpus with taskset on big machines.
+
+static const int PING_PONG_ROUND_TRIPS = 4096;
+static const int FALSE_SHARING_INCREMENTS = 1 << 16;
+// two lines, since the adjacent line prefetcher pulls lines in pairs
+static const std::size_t FALSE_SHARING_PAD = 128;
+
+// one-way transfer time in seconds, half of a round trip
+Stats measurePingPong(int cpu_a, int cpu_b, std::atomic<std::uint64_t>* p_line,
+                      const Harness& harness)
+{
+  std::vector<int> cpus;
+  cpus.push_back(cpu_a);
+  cpus.push_back(cpu_b);
+  p_line->store(0, std::memory_order_relaxed);
+
+  // thread 0 makes the line odd and waits for thread 1 to make it even
+  // again; every repetition starts and ends on an even value
+  LockstepRun run = runLockstep(cpus, 2, harness, [&](int t)
+  {
+    for (int i = 0; i < PING_PONG_ROUND_TRIPS; ++i)
+    {
+      if (t == 0)
+      {
+        std::uint64_t value = p_line->load(std::memory_order_relaxed);
+        p_line->store(value + 1, std::memory_order_release);
+        while (p_line->load(std::memory_order_acquire) != value + 2)
+        {
+        }
+      }
+      else
+      {
+        std::uint64_t value;
+        while (((value = p_line->load(std::memory_order_acquire)) & 1) == 0)
+        {
+        }
+        p_line->store(value + 1, std::memory_order_release);
+      }
+    }
+  });
+
+  std::vector<double> one_way = run.perThread[0].values;
+  for (std::size_t i = 0; i < one_way.size(); ++i)
+  {
+    one_way[i] /= 2.0 * PING_PONG_ROUND_TRIPS;
+  }
+  Stats stats = summarize(one_way);
+  stats.counters = scaleCounters(run.aggregate.counters, 2.0 * PING_PONG_ROUND_TRIPS);
+  return stats;
+}
+
+// seconds per increment with both threads incrementing their own counter
+Stats measureFalseSharing(int cpu_a, int cpu_b, char* p_buf, std::size_t distance,
+                          const Harness& harness)
+{
+  std::vector<int> cpus;
+  cpus.push_back(cpu_a);
+  cpus.push_back(cpu_b);
+  std::atomic<std::uint64_t>* p_counters[2] = {
+    new (p_buf) std::atomic<std::uint64_t>(0),
+    new (p_buf + distance) std::atomic<std::uint64_t>(0),
+  };
+
+  LockstepRun run = runLockstep(cpus, 2, harness, [&](int t)
+  {
+    std::atomic<std::uint64_t>* p_counter = p_counters[t];
+    for (int i = 0; i < FALSE_SHARING_INCREMENTS; ++i)
+    {
+      p_counter->fetch_add(1, std::memory_order_relaxed);
+    }
+  });
+
+  Stats stats = run.aggregate;
+  std::vector<double> per_increment = stats.values;
+  for (std::size_t i = 0; i < per_increment.size(); ++i)
+  {
+    per_increment[i] /= FALSE_SHARING_INCREMENTS;
+  }
+  Stats result = summarize(per_increment);
+  result.counters = scaleCounters(stats.counters, FALSE_SHARING_INCREMENTS);
+  return result;
+}
+
+void printCpuMatrix(const std::string& title, const std::vector<int>& cpus,
+                    const std::vector<std::vector<double> >& matrix)
+{
+  std::cout << "# " << title << std::endl << "cpu";
+  for (std::size_t b = 0; b < cpus.size(); ++b)
+  {
+    std::cout << "," << cpus[b];
+  }
+  std::cout << std::endl;
+  for (std::size_t a = 0; a < cpus.size(); ++a)
+  {
+    std::cout << cpus[a];
+    for (std::size_t b = 0; b < cpus.size(); ++b)
+    {
+      std::cout << ",";
+      if (a != b)
+      {
+        std::cout << matrix[a][b];
+      }
+    }
+    std::cout << std::endl;
+  }
+}
+
+int runCoreToCore(const Harness& harness)
+{
+  std::vector<int> cpus = allowedCpus();
+  if (cpus.size() < 2)
+  {
+    std::cerr << "ERROR: core to core test needs at least 2 cpus, have "
+              << cpus.size() << std::endl;
+    return 1;
+  }
+
+  const std::size_t page = sysconf(_SC_PAGESIZE);
+  char* p_buf = mapUntouched(page);
+  if (p_buf == NULL)
+  {
+    std::cerr << "ERROR: mmap for core to core test failed!" << std::endl;
+    return 1;
+  }
+  std::atomic<std::uint64_t>* p_line = new (p_buf) std::atomic<std::uint64_t>(0);
+
+  const std::size_t n = cpus.size();
+  std::vector<std::vector<double> > latency(n, std::vector<double>(n, 0.0));
+  std::vector<std::vector<double> > packed(n, std::vector<double>(n, 0.0));
+  std::vector<std::vector<double> > slowdown(n, std::vector<double>(n, 0.0));
+  std::vector<double> packed_all;
+  std::vector<double> padded_all;
+
+  // transfers are symmetric, so each pair runs once and fills both cells
+  for (std::size_t a = 0; a < n; ++a)
+  {
+    for (std::size_t b = a + 1; b < n; ++b)
+    {
+      const std::string pair = std::to_string(cpus[a]) + "/" + std::to_string(cpus[b]);
+
+      Stats ping = measurePingPong(cpus[a], cpus[b], p_line, harness);
+      latency[a][b] = latency[b][a] = ping.median * 1.0e9;
+      recordResult("c2c", "pingpong/" + pair, ping);
+
+      Stats packed_stats = measureFalseSharing(cpus[a], cpus[b], p_buf,
+                                               sizeof(std::uint64_t), harness);
+      Stats padded_stats = measureFalseSharing(cpus[a], cpus[b], p_buf,
+                                               FALSE_SHARING_PAD, harness);
+      packed[a][b] = packed[b][a] = packed_stats.median * 1.0e9;
+      slowdown[a][b] = slowdown[b][a] = packed_stats.median / padded_stats.median;
+      packed_all.push_back(packed_stats.median * 1.0e9);
+      padded_all.push_back(padded_stats.median * 1.0e9);
+      recordResult("c2c", "packed/" + pair, packed_stats);
+      recordResult("c2c", "padded/" + pair, padded_stats);
+    }
+  }
+
+  printCpuMatrix("core to core one-way cache line transfer, ns (round trip / 2)",
+                 cpus, latency);
+  std::cout << std::endl;
+  printCpuMatrix("false sharing, packed counters, ns per increment", cpus, packed);
+  std::cout << std::endl;
+  printCpuMatrix("false sharing slowdown, packed / padded (" +
+                 std::to_string(FALSE_SHARING_PAD) + " bytes apart)", cpus, slowdown);
+
+  Stats packed_summary = summarize(packed_all);
+  Stats padded_summary = summarize(padded_all);
+  std::cout << std::endl << "# median over " << packed_all.size() << " pairs: packed "
+            << packed_summary.median << "ns, padded " << padded_summary.median
+            << "ns per increment" << std::endl;
+
+  munmap(p_buf, page);
+  return 0;
+}
+
+/////////////
+// background noise
+//
+// An aggressor runs one bandwidth op on its own threads, throttled to a
+// target rate, while something else is measured. --aggressor puts it next
+// to any other mode and reports how much each result degraded against a
+// quiet run; --noise runs only the aggressor, as interference for the other
+// benchmarks in this repo.
+
+static const std::uint64_t AGGRESSOR_BYTES = 256 * 1024 * 1024;
+static const std::uint64_t AGGRESSOR_CHUNK = 256 * 1024;
+
+int bandwidthOpByName(const std::string& name)
+{
+  for (int op = 0; op < OP_COUNT; ++op)
+  {
+    if (name == bandwidthOpName(op))
+    {
+      return op;
+    }
+  }
+  return -1;
+}
+
+class Aggressor
+{
+ public:
+  // rate is the total in bytes per second over all threads, 0 for flat out
+  Aggressor(int op, int numThreads, double rate)
+      : mOp(op),
+        mNumThreads(numThreads),
+        mRate(rate),
+        mSliceBytes(0),
+        mpSrc(NULL),
+        mpDest(NULL),
+        mReady(numThreads + 1),
+        mStop(false),
+        mBytes(0),
+        mStart(0)
+  {
+  }
+
+  ~Aggressor()
+  {
+    stop();
+    if (mpSrc != NULL) munmap(mpSrc, AGGRESSOR_BYTES);
+    if (mpDest != NULL) munmap(mpDest, AGGRESSOR_BYTES);
+  }
+
+  bool start()
+  {
+    mpSrc = mapUntouched(AGGRESSOR_BYTES);
+    mpDest = mapUntouched(AGGRESSOR_BYTES);
+    mSliceBytes = AGGRESSOR_BYTES / mNumThreads / AGGRESSOR_CHUNK * AGGRESSOR_CHUNK;
+    if (mpSrc == NULL || mpDest == NULL || mSliceBytes == 0)
+    {
+      return false;
+    }
+
+    // aggressors take the cpus from the top, benchmarks pin from the bottom
+    std::vector<int> cpus = allowedCpus();
+    mStop.store(false);
+    mBytes.store(0);
+    for (int t = 0; t < mNumThreads; ++t)
+    {
+      int cpu = cpus[cpus.size() - 1 - t % cpus.size()];
+      mThreads.push_back(std::thread(&Aggressor::run, this, t, cpu));
+    }
+    // the clock starts once every thread has faulted its buffers in
+    mReady.wait();
+    mStart = nowNs();
+    return true;
+  }
+
+  void stop()
+  {
+    mStop.store(true);
+    for (std::size_t t = 0; t < mThreads.size(); ++t)
+    {
+      mThreads[t].join();
+    }
+    mThreads.clear();
+  }
+
+  // bytes per second since start()
+  double achievedRate() const
+  {
+    return mBytes.load() / ((nowNs() - mStart) / 1.0e9);
+  }
+
+ private:
+  void run(int t, int cpu)
+  {
+    pinToCpu(cpu);
+    char* p_src = mpSrc + t * mSliceBytes;
+    char* p_dest = mpDest + t * mSliceBytes;
+    memset(p_src, 0xF, mSliceBytes);
+    memset(p_dest, 0xF, mSliceBytes);
+    mReady.wait();
+
+    const double thread_rate = mRate / mNumThreads;
+    const std::uint64_t start = nowNs();
+    std::uint64_t done = 0;
+    std::uint64_t offset = 0;
+    while (!mStop.load(std::memory_order_relaxed))
+    {
+      runBandwidthOp(mOp, p_dest + offset, p_src + offset, AGGRESSOR_CHUNK, 1);
+      offset = (offset + AGGRESSOR_CHUNK) % mSliceBytes;
+      done += AGGRESSOR_CHUNK;
+      mBytes.fetch_add(AGGRESSOR_CHUNK, std::memory_order_relaxed);
+
+      if (thread_rate > 0.0)
+      {
+        // ahead of schedule: sleep until the bytes so far are due
+        const std::uint64_t due = start + (std::uint64_t)(done * 1.0e9 / thread_rate);
+        const std::uint64_t now = nowNs();
+        if (due > now)
+        {
+          std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+        }
+      }
+    }
+  }
+
+  const int mOp;
+  const int mNumThreads;
+  const double mRate;
+  std::uint64_t mSliceBytes;
+  char* mpSrc;
+  char* mpDest;
+  SpinBarrier mReady;
+  std::vector<std::thread> mThreads;
+  std::atomic<bool> mStop;
+  std::atomic<std::uint64_t> mBytes;
+  std::uint64_t mStart;
+};
+
+std::string describeAggressor(const std::string& op_name, int num_threads, double rate)
+{
+  std::ostringstream out;
+  out << op_name << " on " << num_threads << " thread" << (num_threads == 1 ? "" : "s")
+      << ", target " << (rate > 0.0 ? formatBytes(rate) + "/s" : "unthrottled");
+  return out.str();
+}
+
+// aggressor only, printing the achieved bandwidth once a second; runs until
+// killed when duration_seconds is 0
+int runNoise(int op, int num_threads, double rate, double duration_seconds)
+{
+  Aggressor aggressor(op, num_threads, rate);
+  if (!aggressor.start())
+  {
+    std::cerr << "ERROR: mmap of 2x " << formatBytes(AGGRESSOR_BYTES)
+              << " for the aggressor failed!" << std::endl;
+    return 1;
+  }
+  std::cout << "Background noise: "
+            << describeAggressor(bandwidthOpName(op), num_threads, rate) << std::endl;
+
+  Timer timer;
+  while (duration_seconds <= 0.0 || timer.elapsedSec() < duration_seconds)
+  {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    std::cout << "  " << timer.elapsedSec() << "s: "
+              << formatBytes(aggressor.achievedRate()) << "/s" << std::endl;
+  }
+  aggressor.stop();
+  recordValue("noise", "achieved", aggressor.achievedRate(), "B/s", false);
+  return 0;
+}
+
+/////////////
+// json output and baseline comparison
+
+std::string jsonEscape(const std::string& text)
+{
+  std::string escaped;
+  for (std::size_t i = 0; i < text.size(); ++i)
+  {
+    const char c = text[i];
+    switch (c)
+    {
+      case '"': escaped += "\\\""; break;
+      case '\\': escaped += "\\\\"; break;
+      case '\n': escaped += "\\n"; break;
+      case '\t': escaped += "\\t"; break;
+      default:
+        if ((unsigned char)c < 0x20)
+        {
+          char buf[8];
+          snprintf(buf, sizeof(buf), "\\u%04x", c);
+          escaped += buf;
+        }
+        else
+        {
+          escaped += c;
+        }
+    }
+  }
+  return escaped;
+}
+
+// json has no inf or nan
+std::string jsonNumber(double value)
+{
+  if (!std::isfinite(value))
+  {
+    return "null";
+  }
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.9g", value);
+  return buf;
+}
+
+void writeJson(std::ostream& out, int argc, char* argv[])
+{
+  out << "{\n  \"schema\": \"memtest-results/1\",\n  \"args\": [";
+  for (int i = 1; i < argc; ++i)
+  {
+    out << (i > 1 ? ", " : "") << "\"" << jsonEscape(argv[i]) << "\"";
+  }
+  out << "],\n";
+
+  struct utsname uts;
+  const bool have_uts = uname(&uts) == 0;
+  out << "  \"host\": {\n"
+      << "    \"cpus\": " << allowedCpus().size() << ",\n"
+      << "    \"page_size\": " << sysconf(_SC_PAGESIZE) << ",\n"
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+      << "    \"l1d_bytes\": " << sysconf(_SC_LEVEL1_DCACHE_SIZE) << ",\n"
+      << "    \"l2_bytes\": " << sysconf(_SC_LEVEL2_CACHE_SIZE) << ",\n"
+      << "    \"l3_bytes\": " << sysconf(_SC_LEVEL3_CACHE_SIZE) << ",\n"
+#endif
+      << "    \"kernel\": \"" << (have_uts ? jsonEscape(uts.release) : "") << "\",\n"
+#ifdef __GLIBC__
+      << "    \"libc\": \"glibc " << gnu_get_libc_version() << "\",\n"
+#endif
+      << "    \"compiler\": \"" << jsonEscape(__VERSION__) << "\",\n"
+      << "    \"clock\": \"" << (tscClock().enabled ? "tsc" : "steady_clock") << "\"\n"
+      << "  },\n  \"results\": [";
+
+  const std::vector<Result>& all = results();
+  for (std::size_t r = 0; r < all.size(); ++r)
+  {
+    const Result& result = all[r];
+    const Stats& stats = result.stats;
+    out << (r > 0 ? "," : "") << "\n    {\"benchmark\": \"" << jsonEscape(result.benchmark)
+        << "\", \"name\": \"" << jsonEscape(result.name)
+        << "\", \"unit\": \"" << jsonEscape(result.unit)
+        << "\", \"lower_is_better\": " << (result.lowerIsBetter ? "true" : "false")
+        << ", \"bytes\": " << result.bytes
+        << ", \"samples\": " << stats.samples
+        << ", \"min\": " << jsonNumber(stats.min)
+        << ", \"median\": " << jsonNumber(stats.median)
+        << ", \"p95\": " << jsonNumber(stats.p95)
+        << ", \"p99\": " << jsonNumber(stats.p99)
+        << ", \"max\": " << jsonNumber(stats.max)
+        << ", \"mean\": " << jsonNumber(stats.mean)
+        << ", \"stddev\": " << jsonNumber(stats.stddev)
+        << ", \"values\": [";
+    for (std::size_t v = 0; v < stats.values.size(); ++v)
+    {
+      out << (v > 0 ? ", " : "") << jsonNumber(stats.values[v]);
+    }
+    out << "]";
+    if (hasCounters(stats.counters))
+    {
+      // per timed unit, same as the stats
+      out << ", \"counters\": {";
+      const char* separator = "";
+      for (int id = 0; id < CTR_COUNT; ++id)
+      {
+        if (stats.counters.valid[id])
+        {
+          out << separator << "\"" << counterName(id) << "\": "
+              << jsonNumber(stats.counters.value[id]);
+          separator = ", ";
+        }
+      }
+      out << "}";
+    }
+    out << "}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+struct JsonValue
+{
+  enum Type
+  {
+    NUL,
+    BOOLEAN,
+    NUMBER,
+    STRING,
+    ARRAY,
+    OBJECT
+  };
+
+  JsonValue()
+      : type(NUL),
+        boolean(false),
+        number(0.0)
   {
-    update();
   }
 
-  void update()
+  const JsonValue* member(const std::string& key) const
   {
-    mStart = std::chrono::high_resolution_clock::now();
-    mStop  = mStart;
+    for (std::size_t i = 0; i < members.size(); ++i)
+    {
+      if (members[i].first == key)
+      {
+        return &members[i].second;
+      }
+    }
+    return NULL;
   }
 
-  double elapsedMs()
+  double numberOr(const std::string& key, double fallback) const
   {
-    mStop = std::chrono::high_resolution_clock::now();
-    std::chrono::milliseconds elapsed_ms =
-        std::chrono::duration_cast<std::chrono::milliseconds>(mStop - mStart);
-    return elapsed_ms.count();
+    const JsonValue* p_value = member(key);
+    return p_value != NULL && p_value->type == NUMBER ? p_value->number : fallback;
   }
 
- private:
-  std::chrono::high_resolution_clock::time_point mStart;
-  std::chrono::high_resolution_clock::time_point mStop;
+  Type type;
+  bool boolean;
+  double number;
+  std::string text;
+  std::vector<JsonValue> items;
+  std::vector<std::pair<std::string, JsonValue> > members;
 };
 
-std::string formatBytes(std::uint64_t bytes)
+// just enough json to read back what writeJson() produces
+class JsonParser
 {
-  static const int num_suffix = 5;
-  static const char* suffix[num_suffix] = { "B", "KB", "MB", "GB", "TB" };
-  double dbl_s_byte = bytes;
-  int i = 0;
-  for (; (int)(bytes / 1024.) > 0 && i < num_suffix;
-       ++i, bytes /= 1024.)
+ public:
+  explicit JsonParser(const std::string& text)
+      : mText(text),
+        mPos(0)
   {
-    dbl_s_byte = bytes / 1024.0;
   }
 
-  const int buf_len = 64;
-  char buf[buf_len];
+  bool parse(JsonValue& value)
+  {
+    bool ok = parseValue(value);
+    skipSpace();
+    return ok && mPos == mText.size();
+  }
 
-  // use snprintf so there is no buffer overrun
-  int res = snprintf(buf, buf_len,"%0.2f%s", dbl_s_byte, suffix[i]);
+ private:
+  void skipSpace()
+  {
+    while (mPos < mText.size() && isspace((unsigned char)mText[mPos]))
+    {
+      ++mPos;
+    }
+  }
 
-  // snprintf returns number of characters that would have been written if n had
-  //       been sufficiently large, not counting the terminating null character.
-  //       if an encoding error occurs, a negative number is returned.
-  if (res >= 0)
+  bool consume(const char* literal)
   {
-    return std::string(buf);
+    std::size_t len = strlen(literal);
+    if (mText.compare(mPos, len, literal) != 0)
+    {
+      return false;
+    }
+    mPos += len;
+    return true;
   }
-  return std::string();
+
+  bool parseString(std::string& out)
+  {
+    if (!consume("\""))
+    {
+      return false;
+    }
+    while (mPos < mText.size() && mText[mPos] != '"')
+    {
+      char c = mText[mPos++];
+      if (c != '\\')
+      {
+        out += c;
+        continue;
+      }
+      if (mPos >= mText.size())
+      {
+        return false;
+      }
+      c = mText[mPos++];
+      switch (c)
+      {
+        case 'n': out += '\n'; break;
+        case 't': out += '\t'; break;
+        case 'r': out += '\r'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'u':
+        {
+          if (mPos + 4 > mText.size())
+          {
+            return false;
+          }
+          unsigned long code = strtoul(mText.substr(mPos, 4).c_str(), NULL, 16);
+          mPos += 4;
+          // names are ascii; anything else only needs to survive a round trip
+          out += code < 0x80 ? (char)code : '?';
+          break;
+        }
+        default: out += c; break;
+      }
+    }
+    return consume("\"");
+  }
+
+  bool parseValue(JsonValue& value)
+  {
+    skipSpace();
+    if (mPos >= mText.size())
+    {
+      return false;
+    }
+
+    const char c = mText[mPos];
+    if (c == '{')
+    {
+      value.type = JsonValue::OBJECT;
+      ++mPos;
+      skipSpace();
+      if (consume("}"))
+      {
+        return true;
+      }
+      do
+      {
+        std::pair<std::string, JsonValue> member;
+        skipSpace();
+        if (!parseString(member.first))
+        {
+          return false;
+        }
+        skipSpace();
+        if (!consume(":") || !parseValue(member.second))
+        {
+          return false;
+        }
+        value.members.push_back(member);
+        skipSpace();
+      } while (consume(","));
+      return consume("}");
+    }
+    if (c == '[')
+    {
+      value.type = JsonValue::ARRAY;
+      ++mPos;
+      skipSpace();
+      if (consume("]"))
+      {
+        return true;
+      }
+      do
+      {
+        value.items.push_back(JsonValue());
+        if (!parseValue(value.items.back()))
+        {
+          return false;
+        }
+        skipSpace();
+      } while (consume(","));
+      return consume("]");
+    }
+    if (c == '"')
+    {
+      value.type = JsonValue::STRING;
+      return parseString(value.text);
+    }
+    if (consume("true") || consume("false"))
+    {
+      value.type = JsonValue::BOOLEAN;
+      value.boolean = mText[mPos - 1] == 'e' && mText[mPos - 2] == 'u';
+      return true;
+    }
+    if (consume("null"))
+    {
+      value.type = JsonValue::NUL;
+      return true;
+    }
+
+    const char* p_start = mText.c_str() + mPos;
+    char* p_end = NULL;
+    value.number = strtod(p_start, &p_end);
+    if (p_end == p_start)
+    {
+      return false;
+    }
+    value.type = JsonValue::NUMBER;
+    mPos += p_end - p_start;
+    return true;
+  }
+
+  const std::string& mText;
+  std::size_t mPos;
+};
+
+// two sided 95% critical value of Student's t; floors the degrees of
+// freedom, which errs on the wide side
+double tCritical95(double df)
+{
+  static const double table[30] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+  };
+  if (df < 1.0)
+  {
+    return table[0];
+  }
+  if (df < 31.0)
+  {
+    return table[(int)df - 1];
+  }
+  if (df < 61.0)
+  {
+    return 2.000;
+  }
+  return df < 121.0 ? 1.980 : 1.960;
 }
 
-void doMemmove(void* pDest, const void* pSource, std::size_t sizeBytes)
+std::string formatValue(double value, const std::string& unit)
 {
-  memmove(pDest, pSource, sizeBytes);
+  std::ostringstream out;
+  if (unit == "s")
+  {
+    if (value < 1.0e-6) out << value * 1.0e9 << "ns";
+    else if (value < 1.0e-3) out << value * 1.0e6 << "us";
+    else out << value * 1.0e3 << "ms";
+  }
+  else if (unit == "B/s")
+  {
+    out << formatBytes(value) << "/s";
+  }
+  else
+  {
+    out << value << unit;
+  }
+  return out.str();
 }
 
-int main(int argc, char* argv[])
+// Compares this run's results with a --json file from an earlier one. A
+// result regresses when the 95% confidence interval (Welch) of the change
+// in means lies entirely on the worse side and the change is bigger than
+// threshold_pct. Returns 2 if anything regressed, 1 on errors.
+int compareWithBaseline(const std::string& path, double threshold_pct, std::ostream& out)
 {
-  std::uint64_t SIZE_BYTES = 1073741824; // 1GB
+  std::ifstream file(path.c_str());
+  if (!file)
+  {
+    std::cerr << "ERROR: can't open baseline " << path << std::endl;
+    return 1;
+  }
+  std::stringstream contents;
+  contents << file.rdbuf();
+  const std::string text = contents.str();
 
-  if (argc > 1)
+  JsonValue root;
+  JsonParser parser(text);
+  const JsonValue* p_results = NULL;
+  if (!parser.parse(root) || (p_results = root.member("results")) == NULL ||
+      p_results->type != JsonValue::ARRAY)
   {
-    SIZE_BYTES = std::stoull(argv[1]);
-    std::cout << "Using buffer size from command line: " << formatBytes(SIZE_BYTES)
-              << std::endl;
+    std::cerr << "ERROR: " << path << " is not a memtest --json file" << std::endl;
+    return 1;
   }
-  else
+
+  std::map<std::string, const JsonValue*> baseline;
+  for (std::size_t i = 0; i < p_results->items.size(); ++i)
   {
-    std::cout << "To specify a custom buffer size: big_memcpy_test [SIZE_BYTES] \n"
-              << "Using built in buffer size: " << formatBytes(SIZE_BYTES)
-              << std::endl;
+    const JsonValue& item = p_results->items[i];
+    const JsonValue* p_benchmark = item.member("benchmark");
+    const JsonValue* p_name = item.member("name");
+    if (p_benchmark != NULL && p_name != NULL)
+    {
+      baseline[p_benchmark->text + "/" + p_name->text] = &item;
+    }
+  }
+
+  int compared = 0;
+  int regressions = 0;
+  int improvements = 0;
+  int unmatched = 0;
+  const std::vector<Result>& all = results();
+  out << std::endl << "Comparison with " << path << " (threshold " << threshold_pct
+      << "%, positive changes are worse):" << std::endl;
+  for (std::size_t r = 0; r < all.size(); ++r)
+  {
+    const Result& result = all[r];
+    const std::string key = result.benchmark + "/" + result.name;
+    std::map<std::string, const JsonValue*>::const_iterator it = baseline.find(key);
+    if (it == baseline.end())
+    {
+      ++unmatched;
+      continue;
+    }
+
+    const JsonValue& base = *it->second;
+    const double base_mean = base.numberOr("mean", 0.0);
+    const double base_sd = base.numberOr("stddev", 0.0);
+    const double base_n = base.numberOr("samples", 0.0);
+    const Stats& cur = result.stats;
+    if (base_mean == 0.0 || !std::isfinite(cur.mean))
+    {
+      ++unmatched;
+      continue;
+    }
+    ++compared;
+
+    // positive is worse, whichever way the unit points
+    const double sign = result.lowerIsBetter ? 1.0 : -1.0;
+    const double worse = sign * (cur.mean - base_mean);
+    const double change_pct = 100.0 * worse / base_mean;
+
+    bool has_ci = base_n >= 2 && cur.samples >= 2;
+    double lo_pct = change_pct;
+    double hi_pct = change_pct;
+    if (has_ci)
+    {
+      const double vb = base_sd * base_sd / base_n;
+      const double vc = cur.stddev * cur.stddev / cur.samples;
+      const double se = std::sqrt(vb + vc);
+      const double denom = vb * vb / (base_n - 1) + vc * vc / (cur.samples - 1);
+      const double df = denom > 0.0 ? (vb + vc) * (vb + vc) / denom : 1.0e9;
+      const double half = tCritical95(df) * se;
+      lo_pct = 100.0 * (worse - half) / base_mean;
+      hi_pct = 100.0 * (worse + half) / base_mean;
+    }
+
+    const char* verdict = NULL;
+    if (lo_pct > 0.0 && change_pct > threshold_pct)
+    {
+      verdict = "REGRESSION";
+      ++regressions;
+    }
+    else if (hi_pct < 0.0 && -change_pct > threshold_pct)
+    {
+      verdict = "improvement";
+      ++improvements;
+    }
+    if (verdict != NULL)
+    {
+      out << "  " << verdict << " " << key << ": " << formatValue(base_mean, result.unit)
+          << " -> " << formatValue(cur.mean, result.unit) << " (" << (change_pct > 0 ? "+" : "")
+          << change_pct << "%";
+      if (has_ci)
+      {
+        out << ", 95% CI " << lo_pct << "% .. " << hi_pct << "%";
+      }
+      else
+      {
+        out << ", single sample, no CI";
+      }
+      out << ")" << std::endl;
+    }
   }
 
+  out << "  compared " << compared << " results: " << regressions << " regressions, "
+      << improvements << " improvements, " << unmatched << " without baseline"
+      << std::endl;
+  return regressions > 0 ? 2 : 0;
+}
+
+/////////////
+// default test
 
+int runDefaultTests(std::uint64_t SIZE_BYTES, const Harness& harness)
+{
   // big array to use for testing
   char* p_big_array = NULL;
 
@@ -101,24 +4166,29 @@ int main(int argc, char* argv[])
       return 1;
     }
 
+    double elapsed_ms = timer.elapsedMs();
     std::cout << "malloc for " << formatBytes(SIZE_BYTES) << " took "
-              << timer.elapsedMs() << "ms"
+              << elapsed_ms << "ms"
               << std::endl;
+    recordValue("default", "malloc", elapsed_ms / 1.0e3);
   }
 
   /////////////
   // memset
   {
-    Timer timer;
-
-    // set all data in p_big_array to 0
-    memset(p_big_array, 0xF, SIZE_BYTES * sizeof(char));
+    // set all data in p_big_array to 0xF; the warmup runs take the first
+    // touch page faults, so with --warmup 0 the max includes them
+    Stats stats = measure(harness, [&]()
+    {
+      memset(p_big_array, 0xF, SIZE_BYTES * sizeof(char));
+      clobberMemory(p_big_array);
+    });
 
-    double elapsed_ms = timer.elapsedMs();
     std::cout << "memset for " << formatBytes(SIZE_BYTES) << " took "
-              << elapsed_ms << "ms "
-              << "(" << formatBytes(SIZE_BYTES / (elapsed_ms / 1.0e3)) << " bytes/sec)"
-              << std::endl;
+              << stats.median * 1.0e3 << "ms "
+              << "(" << formatRate(SIZE_BYTES, stats.median) << ")" << std::endl
+              << "  " << formatStats(stats, SIZE_BYTES) << std::endl;
+    recordResult("default", "memset", stats, SIZE_BYTES);
   }
 
   /////////////
@@ -135,15 +4205,17 @@ int main(int argc, char* argv[])
     memset(p_dest_array, 0xF, SIZE_BYTES * sizeof(char));
 
     // time only the memcpy FROM p_big_array TO p_dest_array
-    Timer timer;
-
-    memcpy(p_dest_array, p_big_array, SIZE_BYTES * sizeof(char));
+    Stats stats = measure(harness, [&]()
+    {
+      memcpy(p_dest_array, p_big_array, SIZE_BYTES * sizeof(char));
+      clobberMemory(p_dest_array);
+    });
 
-    double elapsed_ms = timer.elapsedMs();
     std::cout << "memcpy for " << formatBytes(SIZE_BYTES) << " took "
-              << elapsed_ms << "ms "
-              << "(" << formatBytes(SIZE_BYTES / (elapsed_ms / 1.0e3)) << " bytes/sec)"
-              << std::endl;
+              << stats.median * 1.0e3 << "ms "
+              << "(" << formatRate(SIZE_BYTES, stats.median) << ")" << std::endl
+              << "  " << formatStats(stats, SIZE_BYTES) << std::endl;
+    recordResult("default", "memcpy", stats, SIZE_BYTES);
 
     // cleanup p_dest_array
     free(p_dest_array);
@@ -164,16 +4236,18 @@ int main(int argc, char* argv[])
     memset(p_dest_array, 0xF, SIZE_BYTES * sizeof(char));
 
     // time only the memmove FROM p_big_array TO p_dest_array
-    Timer timer;
-
-    // memmove(p_dest_array, p_big_array, SIZE_BYTES * sizeof(char));
-    doMemmove(p_dest_array, p_big_array, SIZE_BYTES * sizeof(char));
+    Stats stats = measure(harness, [&]()
+    {
+      // memmove(p_dest_array, p_big_array, SIZE_BYTES * sizeof(char));
+      doMemmove(p_dest_array, p_big_array, SIZE_BYTES * sizeof(char));
+      clobberMemory(p_dest_array);
+    });
 
-    double elapsed_ms = timer.elapsedMs();
     std::cout << "memmove for " << formatBytes(SIZE_BYTES) << " took "
-              << elapsed_ms << "ms "
-              << "(" << formatBytes(SIZE_BYTES / (elapsed_ms / 1.0e3)) << " bytes/sec)"
-              << std::endl;
+              << stats.median * 1.0e3 << "ms "
+              << "(" << formatRate(SIZE_BYTES, stats.median) << ")" << std::endl
+              << "  " << formatStats(stats, SIZE_BYTES) << std::endl;
+    recordResult("default", "memmove", stats, SIZE_BYTES);
 
     // cleanup p_dest_array
     free(p_dest_array);
@@ -187,3 +4261,363 @@ int main(int argc, char* argv[])
 
   return 0;
 }
+
+struct Options
+{
+  std::uint64_t sizeBytes;
+  bool sizeGiven;
+  std::string mode;
+  int numThreads;
+  int stepsPerOctave;
+  std::uint64_t stride;
+  bool hugePages;
+  int alignStep;
+  int reads;
+  int writes;
+  Harness harness;
+  std::string jsonPath;
+  std::string comparePath;
+  double thresholdPct;
+  std::string tracePath;
+  double durationSeconds;
+  std::string aggressorOp;
+  int aggressorThreads;
+  double aggressorRate;
+};
+
+int runBenchmarks(const Options& options)
+{
+  if (options.mode == "kernels")
+  {
+    return runCopyKernels(options.sizeBytes, options.harness);
+  }
+  if (options.mode == "sweep")
+  {
+    // the sweep wants to reach well past the last level cache by default
+    return runSizeSweep(options.sizeGiven ? options.sizeBytes : 4 * options.sizeBytes,
+                        options.stepsPerOctave);
+  }
+  if (options.mode == "latency")
+  {
+    return runLatency(options.sizeBytes, options.stride, options.hugePages,
+                      options.stepsPerOctave, options.harness);
+  }
+  if (options.mode == "tlb")
+  {
+    return runTlbSweep(options.sizeBytes, options.stepsPerOctave, options.harness);
+  }
+  if (options.mode == "alloc")
+  {
+    return runAllocStrategies(options.sizeBytes, options.harness);
+  }
+  if (options.mode == "misalign")
+  {
+    return runMisalignMatrix(options.alignStep, options.harness);
+  }
+  if (options.mode == "malloc-stress")
+  {
+    return runAllocatorStress(options.numThreads, options.durationSeconds,
+                              options.tracePath);
+  }
+  if (options.mode == "noise")
+  {
+    return runNoise(bandwidthOpByName(options.aggressorOp), options.aggressorThreads,
+                    options.aggressorRate, options.durationSeconds);
+  }
+  if (options.mode == "zerocopy")
+  {
+    return runZeroCopy(options.sizeGiven ? options.sizeBytes : 64 * 1024 * 1024,
+                       options.stepsPerOctave, options.harness);
+  }
+  if (options.mode == "c2c")
+  {
+    return runCoreToCore(options.harness);
+  }
+  if (options.mode == "stream")
+  {
+    return runStream(options.sizeBytes, options.numThreads, options.reads,
+                     options.writes, options.harness);
+  }
+  if (options.numThreads >= 0)
+  {
+    return runThreadedBandwidth(options.sizeBytes, options.numThreads, options.harness);
+  }
+
+  if (options.sizeGiven)
+  {
+    std::cout << "Using buffer size from command line: " << formatBytes(options.sizeBytes)
+              << std::endl;
+  }
+  else
+  {
+    std::cout << "To specify a custom buffer size: big_memcpy_test [SIZE_BYTES] \n"
+              << "To run multi-threaded: big_memcpy_test --threads N [SIZE_BYTES]"
+              << " (N = 0 uses every cpu)\n"
+              << "To compare copy kernels: big_memcpy_test --kernels [SIZE_BYTES]\n"
+              << "To sweep sizes as CSV: big_memcpy_test --sweep"
+              << " [--steps-per-octave N] [MAX_BYTES]\n"
+              << "To measure load latency: big_memcpy_test --latency [--stride BYTES]"
+              << " [--hugepages] [MAX_BYTES]\n"
+              << "To find the TLB reach per page size: big_memcpy_test --tlb"
+              << " [--steps-per-octave N] [MAX_BYTES]\n"
+              << "To split page faults from copies: big_memcpy_test --alloc [SIZE_BYTES]\n"
+              << "To run STREAM style kernels: big_memcpy_test --stream [--threads N]"
+              << " [--rw-ratio R:W] [SIZE_BYTES]\n"
+              << "To map misaligned/overlapping small copies as CSV: big_memcpy_test"
+              << " --misalign [--align-step N]\n"
+              << "To compare zero-copy alternatives with memcpy: big_memcpy_test --zerocopy"
+              << " [MAX_BYTES]\n"
+              << "To map core to core latency and false sharing: big_memcpy_test --c2c\n"
+              << "To generate background noise: big_memcpy_test --noise [--aggressor OP]"
+              << " [--aggressor-threads N] [--aggressor-rate BYTES_PER_SEC]"
+              << " [--duration SEC, 0 runs until killed]\n"
+              << "To measure interference on any test: add --aggressor OP"
+              << " (memset, memcpy or memmove) with the options above\n"
+              << "To stress the allocator: big_memcpy_test --malloc-stress [--threads N]"
+              << " [--duration SEC] [--trace SIZES_FILE]\n"
+              << "Timing options: --warmup N --reps N (default 1 and 5), --tsc,"
+              << " --perf (hardware counters per timed region)\n"
+              << "Output options: --json PATH|- and --compare BASELINE.json"
+              << " [--threshold PERCENT]\n"
+              << "Using built in buffer size: " << formatBytes(options.sizeBytes)
+              << std::endl;
+  }
+
+  return runDefaultTests(options.sizeBytes, options.harness);
+}
+
+// Runs the selected benchmark quiet first and then again next to the
+// aggressor, and reports the change of every result between the two. The
+// results of the loaded run are the ones that stay recorded.
+int runWithAggressor(const Options& options)
+{
+  const int op = bandwidthOpByName(options.aggressorOp);
+  std::cout << "### quiet run" << std::endl;
+  int status = runBenchmarks(options);
+  if (status != 0)
+  {
+    return status;
+  }
+  std::vector<Result> quiet;
+  quiet.swap(results());
+
+  Aggressor aggressor(op, options.aggressorThreads, options.aggressorRate);
+  if (!aggressor.start())
+  {
+    std::cerr << "ERROR: mmap of 2x " << formatBytes(AGGRESSOR_BYTES)
+              << " for the aggressor failed!" << std::endl;
+    return 1;
+  }
+  std::cout << std::endl << "### next to aggressor: "
+            << describeAggressor(options.aggressorOp, options.aggressorThreads,
+                                 options.aggressorRate)
+            << std::endl;
+  status = runBenchmarks(options);
+  aggressor.stop();
+  if (status != 0)
+  {
+    return status;
+  }
+  const double achieved = aggressor.achievedRate();
+
+  // degradation is positive when the loaded result is worse
+  std::map<std::string, const Result*> by_name;
+  for (std::size_t r = 0; r < quiet.size(); ++r)
+  {
+    by_name[quiet[r].benchmark + "/" + quiet[r].name] = &quiet[r];
+  }
+  std::cout << std::endl << "### interference, aggressor achieved "
+            << formatBytes(achieved) << "/s" << std::endl
+            << "benchmark,name,unit,quiet,loaded,degradation_pct" << std::endl;
+  const std::vector<Result> loaded = results();
+  for (std::size_t r = 0; r < loaded.size(); ++r)
+  {
+    const Result& result = loaded[r];
+    std::map<std::string, const Result*>::const_iterator found =
+        by_name.find(result.benchmark + "/" + result.name);
+    if (found == by_name.end() || found->second->stats.median == 0.0)
+    {
+      continue;
+    }
+    const double before = found->second->stats.median;
+    const double after = result.stats.median;
+    const double change = 100.0 * (after - before) / before;
+    const double degradation = result.lowerIsBetter ? change : -change;
+    std::cout << result.benchmark << "," << result.name << "," << result.unit << ","
+              << before << "," << after << "," << degradation << std::endl;
+    recordValue("interference", result.benchmark + "/" + result.name, degradation, "%");
+  }
+  recordValue("interference", "aggressor/achieved", achieved, "B/s", false);
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+  Options options;
+  options.sizeBytes = 1073741824; // 1GB
+  options.sizeGiven = false;
+  options.numThreads = -1;
+  options.stepsPerOctave = 4;
+  options.stride = 64;
+  options.hugePages = false;
+  options.alignStep = 1;
+  options.reads = 2;
+  options.writes = 1;
+  options.harness.warmup = 1;
+  options.harness.reps = 5;
+  options.thresholdPct = 5.0;
+  options.durationSeconds = 5.0;
+  options.aggressorThreads = 1;
+  options.aggressorRate = 0.0;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg == "--threads" && i + 1 < argc)
+    {
+      // 0 means one thread per available cpu
+      options.numThreads = std::stoi(argv[++i]);
+    }
+    else if (arg == "--steps-per-octave" && i + 1 < argc)
+    {
+      options.stepsPerOctave = std::stoi(argv[++i]);
+    }
+    else if (arg == "--stride" && i + 1 < argc)
+    {
+      options.stride = std::stoull(argv[++i]);
+    }
+    else if (arg == "--hugepages")
+    {
+      options.hugePages = true;
+    }
+    else if (arg == "--align-step" && i + 1 < argc)
+    {
+      options.alignStep = std::stoi(argv[++i]);
+    }
+    else if (arg == "--rw-ratio" && i + 1 < argc)
+    {
+      // READS:WRITES for the mixed stream kernel
+      if (sscanf(argv[++i], "%d:%d", &options.reads, &options.writes) != 2)
+      {
+        std::cerr << "ERROR: --rw-ratio expects READS:WRITES" << std::endl;
+        return 1;
+      }
+    }
+    else if (arg == "--warmup" && i + 1 < argc)
+    {
+      options.harness.warmup = std::max(0, std::stoi(argv[++i]));
+    }
+    else if (arg == "--reps" && i + 1 < argc)
+    {
+      options.harness.reps = std::max(1, std::stoi(argv[++i]));
+    }
+    else if (arg == "--tsc")
+    {
+      if (!enableTscClock())
+      {
+        std::cerr << "NOTE: no invariant tsc, timing with steady_clock" << std::endl;
+      }
+    }
+    else if (arg == "--duration" && i + 1 < argc)
+    {
+      options.durationSeconds = std::stod(argv[++i]);
+    }
+    else if (arg == "--trace" && i + 1 < argc)
+    {
+      options.tracePath = argv[++i];
+    }
+    else if (arg == "--aggressor" && i + 1 < argc)
+    {
+      options.aggressorOp = argv[++i];
+    }
+    else if (arg == "--aggressor-threads" && i + 1 < argc)
+    {
+      options.aggressorThreads = std::stoi(argv[++i]);
+    }
+    else if (arg == "--aggressor-rate" && i + 1 < argc)
+    {
+      options.aggressorRate = std::stod(argv[++i]);
+    }
+    else if (arg == "--perf")
+    {
+      openPerfCounters();
+    }
+    else if (arg == "--json" && i + 1 < argc)
+    {
+      options.jsonPath = argv[++i];
+    }
+    else if (arg == "--compare" && i + 1 < argc)
+    {
+      options.comparePath = argv[++i];
+    }
+    else if (arg == "--threshold" && i + 1 < argc)
+    {
+      options.thresholdPct = std::stod(argv[++i]);
+    }
+    else if (arg == "--kernels" || arg == "--sweep" || arg == "--latency" ||
+             arg == "--alloc" || arg == "--stream" || arg == "--misalign" ||
+             arg == "--c2c" || arg == "--malloc-stress" || arg == "--tlb" ||
+             arg == "--zerocopy" || arg == "--noise")
+    {
+      options.mode = arg.substr(2);
+    }
+    else
+    {
+      options.sizeBytes = std::stoull(arg);
+      options.sizeGiven = true;
+    }
+  }
+
+  // with --json - the report owns stdout and the usual text goes to stderr
+  std::streambuf* p_stdout = std::cout.rdbuf();
+  if (options.jsonPath == "-")
+  {
+    std::cout.rdbuf(std::cerr.rdbuf());
+  }
+
+  int status = 0;
+  if (options.mode == "noise" || !options.aggressorOp.empty())
+  {
+    if (options.mode == "noise" && options.aggressorOp.empty())
+    {
+      options.aggressorOp = bandwidthOpName(OP_MEMCPY);
+    }
+    if (bandwidthOpByName(options.aggressorOp) < 0 || options.aggressorThreads < 1)
+    {
+      std::cerr << "ERROR: aggressor needs memset, memcpy or memmove and at least"
+                << " one thread" << std::endl;
+      status = 1;
+    }
+  }
+  if (status == 0)
+  {
+    status = options.aggressorOp.empty() || options.mode == "noise" ?
+        runBenchmarks(options) : runWithAggressor(options);
+  }
+
+  if (status == 0 && !options.jsonPath.empty())
+  {
+    if (options.jsonPath == "-")
+    {
+      std::ostream json_out(p_stdout);
+      writeJson(json_out, argc, argv);
+    }
+    else
+    {
+      std::ofstream json_out(options.jsonPath.c_str());
+      writeJson(json_out, argc, argv);
+      if (!json_out)
+      {
+        std::cerr << "ERROR: writing " << options.jsonPath << " failed" << std::endl;
+        status = 1;
+      }
+    }
+  }
+  if (status == 0 && !options.comparePath.empty())
+  {
+    status = compareWithBaseline(options.comparePath, options.thresholdPct, std::cout);
+  }
+
+  std::cout.rdbuf(p_stdout);
+  return status;
+}